@@ -0,0 +1,91 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// CEC bit timings (HDMI 1.4b CEC 5.2), in microseconds.
+const int64_t CEC_START_BIT_US = 4500;
+const int64_t CEC_DATA_BIT_US = 2400;
+// 8 data bits, EOM and ACK
+const int64_t CEC_BYTE_US = 10 * CEC_DATA_BIT_US;
+// Signal free time before the next frame from the same initiator
+const int64_t CEC_SIGNAL_FREE_US = 7 * CEC_DATA_BIT_US;
+
+// Share of the bus the service paces itself to, leaving room for frames
+// sent by other devices.
+const int BUS_TARGET_UTILIZATION_PERCENT = 70;
+// Bus time that may be spent back to back before pacing starts.
+const int64_t BUS_BURST_US = 250000;
+// Window over which utilization is reported.
+const int BUS_STATS_WINDOW_SEC = 10;
+
+struct BusStatus {
+    std::string adapter;
+    int utilization = 0;
+    int64_t availableMs = 0;
+    uint64_t framesSent = 0;
+    uint64_t deferred = 0;
+    uint64_t deferredTimeMs = 0;
+};
+
+// Token bucket pacing of the CEC bus, one bucket per adapter. Tokens are
+// microseconds of bus time and refill at the target utilization.
+class BusScheduler {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    // On-wire time of one frame of `bytes` bytes including the header.
+    static int64_t frameTime(size_t bytes)
+    {
+        return CEC_SIGNAL_FREE_US + CEC_START_BIT_US + static_cast<int64_t>(bytes) * CEC_BYTE_US;
+    }
+
+    // Takes `cost` us of bus time for the adapter. Returns zero when the
+    // frame may go now, otherwise how long to wait before asking again.
+    std::chrono::microseconds acquire(const std::string &adapter, int64_t cost, Clock::time_point now);
+    // Takes the bus time without ever deferring, for latency sensitive
+    // frames. The bucket may go into debt which later frames pay back.
+    void charge(const std::string &adapter, int64_t cost, Clock::time_point now);
+    std::vector<BusStatus> getStatus();
+
+private:
+    struct Bucket {
+        int64_t tokens = BUS_BURST_US;
+        Clock::time_point last;
+        bool deferring = false;
+        Clock::time_point deferredSince;
+        // Busy time per second of the stats window
+        int64_t busy[BUS_STATS_WINDOW_SEC] = {0};
+        int64_t busySlot = 0;
+        uint64_t framesSent = 0;
+        uint64_t deferred = 0;
+        uint64_t deferredTimeMs = 0;
+    };
+
+    Bucket& refill(const std::string &adapter, Clock::time_point now);
+    void account(Bucket &bucket, int64_t cost, Clock::time_point now);
+
+    std::map<std::string, Bucket> mBuckets;
+    std::mutex mMutex;
+    Clock::time_point mEpoch = Clock::now();
+};
@@ -0,0 +1,82 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+// A device that did not answer a request may just have been busy, so the
+// miss is only remembered for a while
+const int CAPABILITY_NO_REPLY_TTL_MS = 300000;
+// Misses in a row before requests are failed without being sent
+const uint8_t CAPABILITY_NO_REPLY_THRESHOLD = 2;
+
+enum CapabilityFailure : uint8_t {
+    CAPABILITY_ABORTED = 1,
+    CAPABILITY_NO_REPLY = 2
+};
+
+// Opcodes devices are known not to handle, learned from <Feature Abort>
+// and from requests left unanswered. Devices are keyed by vendor and
+// physical address, which unlike the logical address stay the same across
+// reallocation. Everything learned about an address is forgotten when a
+// device is plugged in there.
+//
+// Aborts are kept until then and survive restarts when a file is
+// configured, one tab separated line per opcode:
+//   physical address, opcode, abort reason, vendor
+class CapabilityCache {
+public:
+    struct Entry {
+        CapabilityFailure failure;
+        // <Feature Abort> reason, CAPABILITY_ABORTED only
+        uint8_t reason;
+        std::chrono::steady_clock::time_point until;
+        // Requests left unanswered in a row, CAPABILITY_NO_REPLY only
+        uint8_t misses;
+    };
+
+    static CapabilityCache& instance();
+    // Set from the command line, loads what was saved there before
+    static void configure(const std::string &path);
+
+    void recordAbort(const std::string &vendor, uint16_t address, uint8_t opcode, uint8_t reason);
+    void recordNoReply(const std::string &vendor, uint16_t address, uint8_t opcode);
+    // The device handled the opcode after all
+    void recordSuccess(const std::string &vendor, uint16_t address, uint8_t opcode);
+    // Only aborts and misses that reached CAPABILITY_NO_REPLY_THRESHOLD
+    bool lookup(const std::string &vendor, uint16_t address, uint8_t opcode, Entry &entry);
+    // Drops every device at the address, whatever its vendor
+    void expire(uint16_t address);
+    // Writes the aborts to the configured file if anything changed
+    bool save();
+
+private:
+    typedef std::pair<uint16_t, std::string> DeviceKey;
+
+    CapabilityCache() = default;
+    bool load(const std::string &path);
+    void record(const DeviceKey &key, uint8_t opcode, const Entry &entry);
+
+    std::map<DeviceKey, std::map<uint8_t, Entry>> mDevices;
+    std::mutex mMutex;
+    std::string mPath;
+    bool mDirty = false;
+};
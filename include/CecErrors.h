@@ -31,7 +31,12 @@ enum CecErrorCode {
     CEC_ERR_COMMAND_PARAM_MISSING,
     CEC_ERR_KEY_PARAM_MISSING,
     CEC_ERR_VALUE_PARAM_MISSING,
-    CEC_ERR_UNKNOWN_ERROR
+    CEC_ERR_UNKNOWN_ERROR,
+    CEC_ERR_FRAME_NOT_ACKNOWLEDGED,
+    CEC_ERR_DEST_DEVICE_UNAVAILABLE,
+    CEC_ERR_DEADLINE_EXCEEDED,
+    CEC_ERR_BUSY,
+    CEC_ERR_CMD_UNSUPPORTED_BY_DEVICE
 };
 
 const std::string retrieveErrorText(CecErrorCode errorCode);
@@ -0,0 +1,200 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "LineView.h"
+
+const uint8_t CEC_MAX_OPERANDS = 14;
+const uint8_t CEC_BROADCAST_ADDRESS = 0x0F;
+const uint16_t CEC_INVALID_PHYSICAL_ADDRESS = 0xFFFF;
+
+enum CecOpcode : uint8_t {
+    CEC_OPCODE_FEATURE_ABORT = 0x00,
+    CEC_OPCODE_IMAGE_VIEW_ON = 0x04,
+    CEC_OPCODE_TEXT_VIEW_ON = 0x0D,
+    CEC_OPCODE_SET_MENU_LANGUAGE = 0x32,
+    CEC_OPCODE_STANDBY = 0x36,
+    CEC_OPCODE_USER_CONTROL_PRESSED = 0x44,
+    CEC_OPCODE_USER_CONTROL_RELEASED = 0x45,
+    CEC_OPCODE_GIVE_OSD_NAME = 0x46,
+    CEC_OPCODE_SET_OSD_NAME = 0x47,
+    CEC_OPCODE_SET_OSD_STRING = 0x64,
+    CEC_OPCODE_SYSTEM_AUDIO_MODE_REQUEST = 0x70,
+    CEC_OPCODE_GIVE_AUDIO_STATUS = 0x71,
+    CEC_OPCODE_SET_SYSTEM_AUDIO_MODE = 0x72,
+    CEC_OPCODE_REPORT_AUDIO_STATUS = 0x7A,
+    CEC_OPCODE_GIVE_SYSTEM_AUDIO_MODE_STATUS = 0x7D,
+    CEC_OPCODE_SYSTEM_AUDIO_MODE_STATUS = 0x7E,
+    CEC_OPCODE_ROUTING_CHANGE = 0x80,
+    CEC_OPCODE_ROUTING_INFORMATION = 0x81,
+    CEC_OPCODE_ACTIVE_SOURCE = 0x82,
+    CEC_OPCODE_GIVE_PHYSICAL_ADDRESS = 0x83,
+    CEC_OPCODE_REPORT_PHYSICAL_ADDRESS = 0x84,
+    CEC_OPCODE_REQUEST_ACTIVE_SOURCE = 0x85,
+    CEC_OPCODE_SET_STREAM_PATH = 0x86,
+    CEC_OPCODE_DEVICE_VENDOR_ID = 0x87,
+    CEC_OPCODE_VENDOR_COMMAND = 0x89,
+    CEC_OPCODE_VENDOR_REMOTE_BUTTON_DOWN = 0x8A,
+    CEC_OPCODE_VENDOR_REMOTE_BUTTON_UP = 0x8B,
+    CEC_OPCODE_GIVE_DEVICE_VENDOR_ID = 0x8C,
+    CEC_OPCODE_MENU_REQUEST = 0x8D,
+    CEC_OPCODE_MENU_STATUS = 0x8E,
+    CEC_OPCODE_GIVE_DEVICE_POWER_STATUS = 0x8F,
+    CEC_OPCODE_REPORT_POWER_STATUS = 0x90,
+    CEC_OPCODE_GET_MENU_LANGUAGE = 0x91,
+    CEC_OPCODE_INACTIVE_SOURCE = 0x9D,
+    CEC_OPCODE_CEC_VERSION = 0x9E,
+    CEC_OPCODE_GET_CEC_VERSION = 0x9F,
+    CEC_OPCODE_VENDOR_COMMAND_WITH_ID = 0xA0,
+    CEC_OPCODE_INITIATE_ARC = 0xC0,
+    CEC_OPCODE_REPORT_ARC_INITIATED = 0xC1,
+    CEC_OPCODE_REPORT_ARC_TERMINATED = 0xC2,
+    CEC_OPCODE_REQUEST_ARC_INITIATION = 0xC3,
+    CEC_OPCODE_REQUEST_ARC_TERMINATION = 0xC4,
+    CEC_OPCODE_TERMINATE_ARC = 0xC5,
+    CEC_OPCODE_ABORT = 0xFF
+};
+
+enum CecAddressing : uint8_t {
+    CEC_DIRECTED = 0x01,
+    CEC_BROADCAST = 0x02,
+    CEC_ANY_ADDRESSING = CEC_DIRECTED | CEC_BROADCAST
+};
+
+struct CecOpcodeInfo {
+    uint8_t opcode;
+    const char *name;
+    uint8_t minOperands;
+    uint8_t maxOperands;
+    uint8_t addressing;
+};
+
+// Standard CEC 1.4/2.0 messages. Opcodes missing here can still be sent
+// raw, they are just not checked.
+constexpr CecOpcodeInfo CEC_OPCODE_TABLE[] = {
+    { CEC_OPCODE_FEATURE_ABORT, "feature-abort", 2, 2, CEC_DIRECTED },
+    { CEC_OPCODE_IMAGE_VIEW_ON, "image-view-on", 0, 0, CEC_DIRECTED },
+    { CEC_OPCODE_TEXT_VIEW_ON, "text-view-on", 0, 0, CEC_DIRECTED },
+    { CEC_OPCODE_SET_MENU_LANGUAGE, "set-menu-language", 3, 3, CEC_BROADCAST },
+    { CEC_OPCODE_STANDBY, "standby", 0, 0, CEC_ANY_ADDRESSING },
+    { CEC_OPCODE_USER_CONTROL_PRESSED, "user-control-pressed", 1, 4, CEC_DIRECTED },
+    { CEC_OPCODE_USER_CONTROL_RELEASED, "user-control-released", 0, 0, CEC_DIRECTED },
+    { CEC_OPCODE_GIVE_OSD_NAME, "give-osd-name", 0, 0, CEC_DIRECTED },
+    { CEC_OPCODE_SET_OSD_NAME, "set-osd-name", 1, 14, CEC_DIRECTED },
+    { CEC_OPCODE_SET_OSD_STRING, "set-osd-string", 1, 14, CEC_DIRECTED },
+    { CEC_OPCODE_SYSTEM_AUDIO_MODE_REQUEST, "system-audio-mode-request", 0, 2, CEC_DIRECTED },
+    { CEC_OPCODE_GIVE_AUDIO_STATUS, "give-audio-status", 0, 0, CEC_DIRECTED },
+    { CEC_OPCODE_SET_SYSTEM_AUDIO_MODE, "set-system-audio-mode", 1, 1, CEC_ANY_ADDRESSING },
+    { CEC_OPCODE_REPORT_AUDIO_STATUS, "report-audio-status", 1, 1, CEC_DIRECTED },
+    { CEC_OPCODE_GIVE_SYSTEM_AUDIO_MODE_STATUS, "give-system-audio-mode-status", 0, 0, CEC_DIRECTED },
+    { CEC_OPCODE_SYSTEM_AUDIO_MODE_STATUS, "system-audio-mode-status", 1, 1, CEC_DIRECTED },
+    { CEC_OPCODE_ROUTING_CHANGE, "routing-change", 4, 4, CEC_BROADCAST },
+    { CEC_OPCODE_ROUTING_INFORMATION, "routing-information", 2, 2, CEC_BROADCAST },
+    { CEC_OPCODE_ACTIVE_SOURCE, "active-source", 2, 2, CEC_BROADCAST },
+    { CEC_OPCODE_GIVE_PHYSICAL_ADDRESS, "give-physical-address", 0, 0, CEC_DIRECTED },
+    { CEC_OPCODE_REPORT_PHYSICAL_ADDRESS, "report-physical-address", 3, 3, CEC_BROADCAST },
+    { CEC_OPCODE_REQUEST_ACTIVE_SOURCE, "request-active-source", 0, 0, CEC_BROADCAST },
+    { CEC_OPCODE_SET_STREAM_PATH, "set-stream-path", 2, 2, CEC_BROADCAST },
+    { CEC_OPCODE_DEVICE_VENDOR_ID, "device-vendor-id", 3, 3, CEC_BROADCAST },
+    { CEC_OPCODE_VENDOR_COMMAND, "vendor-command", 1, 14, CEC_DIRECTED },
+    { CEC_OPCODE_VENDOR_REMOTE_BUTTON_DOWN, "vendor-remote-button-down", 1, 14, CEC_ANY_ADDRESSING },
+    { CEC_OPCODE_VENDOR_REMOTE_BUTTON_UP, "vendor-remote-button-up", 0, 0, CEC_ANY_ADDRESSING },
+    { CEC_OPCODE_GIVE_DEVICE_VENDOR_ID, "give-device-vendor-id", 0, 0, CEC_DIRECTED },
+    { CEC_OPCODE_MENU_REQUEST, "menu-request", 1, 1, CEC_DIRECTED },
+    { CEC_OPCODE_MENU_STATUS, "menu-status", 1, 1, CEC_DIRECTED },
+    { CEC_OPCODE_GIVE_DEVICE_POWER_STATUS, "give-device-power-status", 0, 0, CEC_DIRECTED },
+    { CEC_OPCODE_REPORT_POWER_STATUS, "report-power-status", 1, 1, CEC_ANY_ADDRESSING },
+    { CEC_OPCODE_GET_MENU_LANGUAGE, "get-menu-language", 0, 0, CEC_DIRECTED },
+    { CEC_OPCODE_INACTIVE_SOURCE, "inactive-source", 2, 2, CEC_DIRECTED },
+    { CEC_OPCODE_CEC_VERSION, "cec-version", 1, 1, CEC_DIRECTED },
+    { CEC_OPCODE_GET_CEC_VERSION, "get-cec-version", 0, 0, CEC_DIRECTED },
+    { CEC_OPCODE_VENDOR_COMMAND_WITH_ID, "vendor-command-with-id", 3, 14, CEC_ANY_ADDRESSING },
+    { CEC_OPCODE_INITIATE_ARC, "initiate-arc", 0, 0, CEC_DIRECTED },
+    { CEC_OPCODE_REPORT_ARC_INITIATED, "report-arc-initiated", 0, 0, CEC_DIRECTED },
+    { CEC_OPCODE_REPORT_ARC_TERMINATED, "report-arc-terminated", 0, 0, CEC_DIRECTED },
+    { CEC_OPCODE_REQUEST_ARC_INITIATION, "request-arc-initiation", 0, 0, CEC_DIRECTED },
+    { CEC_OPCODE_REQUEST_ARC_TERMINATION, "request-arc-termination", 0, 0, CEC_DIRECTED },
+    { CEC_OPCODE_TERMINATE_ARC, "terminate-arc", 0, 0, CEC_DIRECTED },
+    { CEC_OPCODE_ABORT, "abort", 0, 0, CEC_DIRECTED }
+};
+
+constexpr size_t CEC_OPCODE_TABLE_SIZE = sizeof(CEC_OPCODE_TABLE) / sizeof(CEC_OPCODE_TABLE[0]);
+
+constexpr const CecOpcodeInfo* findCecOpcode(uint8_t opcode, size_t index = 0)
+{
+    return index >= CEC_OPCODE_TABLE_SIZE ? nullptr :
+           CEC_OPCODE_TABLE[index].opcode == opcode ? &CEC_OPCODE_TABLE[index] :
+           findCecOpcode(opcode, index + 1);
+}
+
+constexpr const char* cecOpcodeName(uint8_t opcode)
+{
+    return findCecOpcode(opcode) ? findCecOpcode(opcode)->name : "unknown";
+}
+
+constexpr uint8_t cecFrameHeader(uint8_t initiator, uint8_t destination)
+{
+    return static_cast<uint8_t>(((initiator & 0x0F) << 4) | (destination & 0x0F));
+}
+
+// One CEC message as it travels on the bus. A frame without an opcode is a
+// <Polling Message>.
+struct CecFrame {
+    uint8_t initiator = 0;
+    uint8_t destination = CEC_BROADCAST_ADDRESS;
+    bool hasOpcode = false;
+    uint8_t opcode = 0;
+    uint8_t length = 0;
+    uint8_t operands[CEC_MAX_OPERANDS] = {0};
+
+    bool isBroadcast() const { return destination == CEC_BROADCAST_ADDRESS; }
+};
+
+// Checks a frame against the opcode table: operand count and whether the
+// message may be directed or broadcast. Unknown opcodes pass.
+bool validateCecFrame(const CecFrame &frame);
+
+// Writes opcode and operands as the backend payload, e.g. "44:41".
+// Returns false when the buffer is too small.
+bool encodeCecPayload(const CecFrame &frame, char *buf, size_t size);
+
+// Looks up the <User Control Pressed> UI command code for a key name,
+// e.g. "volume-up". Returns false for unknown keys.
+bool cecUserControlCode(const std::string &key, uint8_t &code);
+
+// Parses an incoming traffic line as reported by the CEC backend,
+// e.g. ">> 4f:82:10:00". Lines for outgoing traffic ("<<") are rejected.
+bool parseIncomingFrame(const LineView &line, CecFrame &frame);
+
+const char* cecLogicalAddressName(uint8_t address);
+std::string cecPhysicalAddressString(uint8_t high, uint8_t low);
+std::string cecPhysicalAddressString(uint16_t address);
+// Parses "a.b.c.d" with one hex digit per part. Returns false for
+// anything else, including addresses with a part after a zero part.
+bool parseCecPhysicalAddress(const std::string &text, uint16_t &address);
+std::string cecPowerStatusString(uint8_t status);
+std::string cecVersionString(uint8_t version);
+std::string cecVendorString(uint32_t vendorId);
+// Reason operand of <Feature Abort>, e.g. "unrecognized opcode"
+const char* cecAbortReasonString(uint8_t reason);
+// The message a device answers the request with, e.g. <Set OSD Name> for
+// <Give OSD Name>. Returns false for messages that expect no answer.
+bool cecExpectedReply(uint8_t opcode, uint8_t &reply);
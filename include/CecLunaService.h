@@ -16,15 +16,19 @@
 
 #pragma once
 
+#include <atomic>
 #include <memory>
 #include <list>
-#include <map>
 #include <glib.h>
 
 #include <luna-service2/lunaservice.hpp>
 
 #include "Logger.h"
 #include "Command.h"
+#include "CecFrame.h"
+#include "ClientScheduler.h"
+#include "ClientTable.h"
+#include "LockFreeQueue.h"
 
 class CecLunaService: public LS::Handle {
 public:
@@ -37,16 +41,48 @@ public:
     bool sendCommand(LSMessage &message);
     bool getConfig(LSMessage &message);
     bool setConfig(LSMessage &message);
-    static void callback(void *ctx, uint16_t clientId, enum CommandType type, std::shared_ptr<CommandResData> respData);
+    bool getEvents(LSMessage &message);
+    bool sendKey(LSMessage &message);
+    bool sendFrame(LSMessage &message);
+    bool getBusStatus(LSMessage &message);
+    bool getTopology(LSMessage &message);
+    static void callback(void *ctx, ClientHandle clientId, enum CommandType type, std::shared_ptr<CommandResData> respData);
 private:
+    // A reply waiting to be sent from the main loop
+    struct Completion {
+        ClientHandle clientId = INVALID_CLIENT_HANDLE;
+        CommandType type = CommandType::LIST_ADAPTERS;
+        std::shared_ptr<CommandResData> respData;
+    };
+    // A completion that did not fit m_completions, sent on its own
+    struct LateCompletion {
+        CecLunaService *service;
+        Completion completion;
+    };
 
-    void handleListAdapters(pbnjson::JValue &requestObj);
-    void handleScan(pbnjson::JValue &requestObj);
-    void handleSendCommand(pbnjson::JValue &requestObj);
-    void handleGetConfig(pbnjson::JValue &requestObj);
-    void handleSetConfig(pbnjson::JValue &requestObj);
+    typedef void (CecLunaService::*RequestHandler)(pbnjson::JValue&, ClientHandle);
+
+    static std::string getCallerId(LSMessage *message);
+    static bool cancelCb(LSHandle *sh, const char *uniqueToken, void *ctx);
+    void trackCommand(ClientHandle clientId, std::shared_ptr<Command> command);
+    static gboolean drainCompletions(gpointer data);
+    static gboolean completeLateCb(gpointer data);
+    void completeRequest(Completion &completion);
+    bool submitRequest(LS::Message &request, pbnjson::JValue &requestObj, RequestHandler handler, bool control = false);
+
+    void handleListAdapters(pbnjson::JValue &requestObj, ClientHandle clientId);
+    void handleScan(pbnjson::JValue &requestObj, ClientHandle clientId);
+    void handleSendCommand(pbnjson::JValue &requestObj, ClientHandle clientId);
+    void handleGetConfig(pbnjson::JValue &requestObj, ClientHandle clientId);
+    void handleSetConfig(pbnjson::JValue &requestObj, ClientHandle clientId);
+    void handleSendFrame(pbnjson::JValue &requestObj, ClientHandle clientId);
     void parseResponseObject(pbnjson::JValue &responseObj, enum CommandType type,
             std::shared_ptr<CommandResData> respData);
-    std::map<uint16_t, LSMessage*> m_clients;
-    uint16_t m_clientId = 0;
+    void postEvent(const std::string &adapter, const CecFrame &frame);
+    LS::SubscriptionPoint m_eventSubscription;
+    ClientTable m_clients;
+    // Every pending call is answered at most once, so this never fills up
+    LockFreeQueue<Completion, CLIENT_TABLE_SLOTS> m_completions;
+    std::atomic<bool> m_completionsScheduled;
+    ClientScheduler m_scheduler;
 };
@@ -0,0 +1,76 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Command.h"
+
+// HDMI tree of one adapter: the TV at 0.0.0.0, switches, then sources.
+// Built from the device table, nodes for switches that do not speak CEC
+// are inferred from the addresses below them. Lookups by physical
+// address, and so by input of any node, are O(1).
+class CecTopology
+{
+public:
+    static const uint8_t NO_NODE = 0xFF;
+
+    struct Node
+    {
+        uint16_t address;
+        // -1 for an inferred switch
+        int8_t logicalAddress;
+        // Logical address of this node, or of the first device below it
+        // in input order, -1 if there is none
+        int8_t device;
+        uint8_t depth;
+        uint8_t parent;
+        uint8_t firstChild;
+        uint8_t nextSibling;
+    };
+
+    CecTopology();
+
+    void rebuild(const std::list<CecDevice> &devices, const std::string &adapter);
+
+    const Node& root() const { return mNodes.front(); }
+    const Node& node(uint8_t index) const { return mNodes[index]; }
+    size_t size() const { return mNodes.size(); }
+    const Node* find(uint16_t address) const;
+
+    // Device reached through input (1-15) of the node at address, -1 if
+    // nothing is known there. With address 0 this is a TV input.
+    int deviceBehindInput(uint16_t address, uint8_t input) const;
+    // Addresses from the TV down to address, empty if it is not in the tree
+    std::vector<uint16_t> path(uint16_t address) const;
+
+    // Nibbles in use, 0 for the TV. The input of a node on its parent is
+    // its last used nibble.
+    static uint8_t depthOf(uint16_t address);
+    static uint8_t inputOf(uint16_t address);
+
+private:
+    uint8_t insert(uint16_t address);
+
+    std::vector<Node> mNodes;
+    std::unordered_map<uint16_t, uint8_t> mIndex;
+};
@@ -0,0 +1,102 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <glib.h>
+
+// Platform callers (system UI and services) against everyone else
+const int CLIENT_WEIGHT_SYSTEM = 4;
+const int CLIENT_WEIGHT_APP = 1;
+// Requests a caller may have queued or in flight at once
+const int MAX_CLIENT_PENDING = 8;
+// Sustained requests per second and burst allowed per caller
+const int CLIENT_RATE_PER_SEC = 10;
+const int CLIENT_RATE_BURST = 20;
+// Requests handed to the controller at once, the rest wait here. Enough
+// for the message queue to have something to coalesce and order by
+// deadline.
+const int MAX_DISPATCHED_REQUESTS = 16;
+// Of those, what one app may hold. Released requests cannot be taken
+// back, so an app with slow requests must not get every slot.
+const int MAX_CLIENT_DISPATCHED = 4;
+// Slots only platform callers may take
+const int RESERVED_SYSTEM_DISPATCHED = 4;
+
+typedef std::function<void()> ClientJob;
+typedef uint32_t ClientJobId;
+
+// Weighted fair queuing of Luna requests across callers. Each caller has
+// its own queue, requests are released to the controller in order of
+// their virtual finish time, so a caller flooding the service only delays
+// its own requests.
+class ClientScheduler {
+public:
+    ClientScheduler();
+    ~ClientScheduler();
+
+    // Rate and quota check, false means the caller should be told to
+    // back off. Does not queue anything.
+    bool admit(const std::string &caller);
+    // Queues an admitted request. The job runs on the main loop once it is
+    // the caller's turn. Control requests are not admitted first and run
+    // right away, whatever the dispatch limits.
+    void submit(const std::string &caller, ClientJobId id, ClientJob job, bool control = false);
+    // Drops a request that was not released yet, false if it already was.
+    bool cancel(const std::string &caller, ClientJobId id);
+    // A released request was answered or cancelled, from any thread.
+    void complete(const std::string &caller);
+
+private:
+    struct Job {
+        double finish;
+        ClientJobId id;
+        ClientJob run;
+        bool control;
+    };
+
+    struct Caller {
+        int weight = CLIENT_WEIGHT_APP;
+        int pending = 0;
+        int dispatched = 0;
+        double lastFinish = 0;
+        double tokens = CLIENT_RATE_BURST;
+        std::chrono::steady_clock::time_point refilled;
+        std::deque<Job> jobs;
+    };
+
+    static int callerWeight(const std::string &caller);
+    Caller& getCaller(const std::string &caller);
+    static void refill(Caller &entry, std::chrono::steady_clock::time_point now);
+    bool canDispatch(const Caller &entry) const;
+    void pruneIdle();
+    void pump();
+    static gboolean pumpCb(gpointer data);
+
+    std::map<std::string, Caller> mCallers;
+    std::mutex mMutex;
+    double mVirtualTime = 0;
+    int mDispatched = 0;
+    std::atomic<bool> mPumpScheduled;
+};
@@ -0,0 +1,80 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <luna-service2/lunaservice.hpp>
+
+#include "Command.h"
+
+// Handle of a pending Luna call. The low bits select the slot, the high
+// bits carry the slot generation so a stale handle never matches a newer
+// call that reuses the slot. 0 is never handed out.
+typedef uint32_t ClientHandle;
+const ClientHandle INVALID_CLIENT_HANDLE = 0;
+
+// Pending Luna calls the service can hold at once
+const uint32_t CLIENT_TABLE_SLOTS = 256;
+
+struct ClientRequest {
+    LSMessage *message = nullptr;
+    std::string caller;
+    std::string token;
+    std::shared_ptr<Command> command;
+};
+
+// Preallocated table of pending Luna calls. Insert, lookup and release are
+// O(1) and allocation free. Owned by the main loop: calls are inserted,
+// answered and cancelled there, so the table takes no lock.
+class ClientTable {
+public:
+    ClientTable();
+
+    // INVALID_CLIENT_HANDLE when every slot is taken
+    ClientHandle insert(ClientRequest request);
+    bool setCommand(ClientHandle handle, std::shared_ptr<Command> command);
+    // Removes the call and hands it back, false if it is already gone.
+    // Exactly one of reply and cancel wins the release.
+    bool release(ClientHandle handle, ClientRequest &request);
+    // Linear in the table size, only used for cancel notifications
+    ClientHandle findToken(const std::string &token);
+
+private:
+    static const uint32_t INDEX_BITS = 8;
+    static const uint32_t INDEX_MASK = (1u << INDEX_BITS) - 1;
+    static const uint32_t GENERATION_MASK = (1u << (32 - INDEX_BITS)) - 1;
+    static const uint32_t NO_SLOT = UINT32_MAX;
+
+    static_assert(CLIENT_TABLE_SLOTS <= (1u << INDEX_BITS), "client table slots do not fit the handle index");
+
+    struct Slot {
+        uint32_t generation = 1;
+        uint32_t nextFree = NO_SLOT;
+        bool used = false;
+        ClientRequest request;
+    };
+
+    Slot* getSlot(ClientHandle handle);
+
+    std::vector<Slot> mSlots;
+    uint32_t mFreeHead;
+};
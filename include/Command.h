@@ -16,17 +16,32 @@
 
 #pragma once
 
+#include <atomic>
+#include <chrono>
 #include <list>
 #include <vector>
 #include <memory>
 
 #include "Logger.h"
+#include "CecFrame.h"
 
 const std::string DEFAULT_CEC_ADAPTER = "cec0";
+// Scan adapter name that scans every adapter at once
+const std::string SCAN_ALL_ADAPTERS = "all";
+// An incremental scan does not poll devices that answered this recently
+const int SCAN_FRESHNESS_MS = 60000;
+// A scan is given up after this, a lost backend reply must not hold up
+// the merged reply of an all adapters scan
+const int SCAN_TIMEOUT_MS = 30000;
 const int DEFAULT_REPLY_TIMEOUT_MS = 1000;
+const int DEFAULT_KEY_REPEAT_INTERVAL_MS = 200;
+const int MIN_KEY_REPEAT_INTERVAL_MS = 50;
+const int MAX_KEY_REPEAT_INTERVAL_MS = 500;
+const int DEFAULT_KEY_HOLD_TIMEOUT_MS = 10000;
+const int MAX_KEY_HOLD_TIMEOUT_MS = 60000;
 
 enum CommandType {
-    LIST_ADAPTERS, SCAN, SEND_COMMAND, GET_CONFIG, SET_CONFIG
+    LIST_ADAPTERS, SCAN, SEND_COMMAND, GET_CONFIG, SET_CONFIG, SEND_KEY, SEND_FRAME
 };
 
 typedef struct ErrorInfo {
@@ -45,6 +60,8 @@ struct ListAdaptersReqData: public CommandReqData {
 
 struct ScanReqData: public CommandReqData {
     std::string adapter = DEFAULT_CEC_ADAPTER;
+    // Poll only stale addresses and ask only for missing fields
+    bool incremental = false;
 };
 
 struct CecCommandArg {
@@ -57,13 +74,40 @@ struct CecCommand {
     std::vector<CecCommandArg> args;
 };
 
+// Commands that change what the user sees or hears, they go before queries
+inline bool isControlCommand(const CecCommand &command) {
+    if (command.name == "active" || command.name == "one-touch-play" || command.name == "osd-display")
+        return true;
+    return command.name == "set-volume" && command.args.size() && !command.args.front().value.empty();
+}
+
 struct SendCommandReqData: public CommandReqData {
     std::string adapter = DEFAULT_CEC_ADAPTER;
     std::string destAddress;
     int32_t timeout = DEFAULT_REPLY_TIMEOUT_MS;
+    // Look an unknown destination up on the bus instead of failing
+    bool discover = false;
     CecCommand command;
 };
 
+// Remote control key forwarded through the key lane, not a queued Command.
+struct SendKeyReqData {
+    std::string adapter = DEFAULT_CEC_ADAPTER;
+    std::string destAddress;
+    std::string key;
+    bool pressed = true;
+    bool hold = false;
+    int32_t repeatInterval = DEFAULT_KEY_REPEAT_INTERVAL_MS;
+    int32_t holdTimeout = DEFAULT_KEY_HOLD_TIMEOUT_MS;
+};
+
+// Raw frame, destination and opcode are already binary.
+struct SendFrameReqData: public CommandReqData {
+    std::string adapter = DEFAULT_CEC_ADAPTER;
+    int32_t timeout = DEFAULT_REPLY_TIMEOUT_MS;
+    CecFrame frame;
+};
+
 struct GetConfigReqData: public CommandReqData {
     std::string key;
     std::string adapter = DEFAULT_CEC_ADAPTER;
@@ -95,12 +139,24 @@ class CecDevice {
     std::string m_cecVersion;
     std::string m_powerStatus;
     std::string m_language;
+    std::string m_adapter = DEFAULT_CEC_ADAPTER;
+    // m_address parsed once, CEC_INVALID_PHYSICAL_ADDRESS if it is not one
+    uint16_t m_physicalAddress = CEC_INVALID_PHYSICAL_ADDRESS;
+    int m_logicalAddress = -1;
+    // Last time the device was heard from
+    std::chrono::steady_clock::time_point m_lastSeen;
+
+    void parseAddress() {
+        if (!parseCecPhysicalAddress(m_address, m_physicalAddress))
+            m_physicalAddress = CEC_INVALID_PHYSICAL_ADDRESS;
+    }
 
 public:
     CecDevice(std::string name, std::string addr, std::string activeSrc, std::string vdr, std::string osd,
             std::string cecVer, std::string powerStat, std::string lang) :
             m_name(std::move(name)), m_address(std::move(addr)), m_activeSource(std::move(activeSrc)), m_vendor(std::move(vdr)), m_osd(std::move(osd)), m_cecVersion(std::move(cecVer)), m_powerStatus(
                     std::move(powerStat)), m_language(std::move(lang)) {
+        parseAddress();
     }
 
     bool hasLogicalAddress() {
@@ -139,16 +195,71 @@ public:
         return m_language;
     }
 
+    int getLogicalAddress() const {
+        return m_logicalAddress;
+    }
+
+    uint16_t getPhysicalAddress() const {
+        return m_physicalAddress;
+    }
+
+    const std::string& getAdapter() const {
+        return m_adapter;
+    }
+
+    std::chrono::steady_clock::time_point getLastSeen() const {
+        return m_lastSeen;
+    }
+
+    void setAddress(std::string addr) {
+        m_address = std::move(addr);
+        parseAddress();
+    }
+
+    void setActiveSource(std::string activeSrc) {
+        m_activeSource = std::move(activeSrc);
+    }
+
+    void setVendor(std::string vdr) {
+        m_vendor = std::move(vdr);
+    }
+
+    void setOsd(std::string osd) {
+        m_osd = std::move(osd);
+    }
+
+    void setCecVersion(std::string cecVer) {
+        m_cecVersion = std::move(cecVer);
+    }
+
+    void setPowerStatus(std::string powerStat) {
+        m_powerStatus = std::move(powerStat);
+    }
+
+    void setLogicalAddress(int addr) {
+        m_logicalAddress = addr;
+    }
+
+    void setAdapter(std::string adapter) {
+        m_adapter = std::move(adapter);
+    }
+
+    void touch() {
+        m_lastSeen = std::chrono::steady_clock::now();
+    }
+
     void printDeviceInfo() const {
         AppLogDebug() <<"CecDevice Info:\n";
         AppLogDebug() <<"Name: " << m_name << "\n";
         AppLogDebug() <<"Address: " << m_address << "\n";
+        AppLogDebug() <<"Logical Address: " << m_logicalAddress << "\n";
         AppLogDebug() <<"ActiveSource: " << m_activeSource << "\n";
         AppLogDebug() <<"Vendor: " << m_vendor << "\n";
         AppLogDebug() <<"OSD: " << m_osd << "\n";
         AppLogDebug() <<"Cec Version: " << m_cecVersion << "\n";
         AppLogDebug() <<"Power Status: " << m_powerStatus << "\n";
         AppLogDebug() <<"Language: " << m_language << "\n";
+        AppLogDebug() <<"Adapter: " << m_adapter << "\n";
     }
 };
 
@@ -165,6 +276,11 @@ struct SendCommandResData: public CommandResData {
     std::vector<SendCommandPayload> payload;
 };
 
+struct SendFrameResData: public CommandResData {
+    bool hasReply = false;
+    CecFrame reply;
+};
+
 struct GetConfigResData: public CommandResData {
     std::string key;
     std::string value;
@@ -175,7 +291,7 @@ typedef std::function<void(std::shared_ptr<CommandResData>)> CommandCallback;
 class Command {
 public:
     Command(enum CommandType type, CommandCallback callback) :
-            m_commandType(type), m_callback(std::move(callback)) {
+            m_commandType(type), m_callback(std::move(callback)), m_cancelled(false) {
     }
     virtual ~Command() {
     }
@@ -193,8 +309,22 @@ public:
         return m_callback;
     }
 
+    // Set when the caller went away, pending work for it is dropped
+    void cancel() {
+        m_cancelled = true;
+    }
+    bool isCancelled() const {
+        return m_cancelled || (m_parent && m_parent->isCancelled());
+    }
+    // For commands run on behalf of another one, cancelled along with it
+    void setParent(std::shared_ptr<Command> parent) {
+        m_parent = std::move(parent);
+    }
+
 private:
     enum CommandType m_commandType;
     CommandCallback m_callback;
     std::shared_ptr<CommandReqData> m_data;
+    std::atomic<bool> m_cancelled;
+    std::shared_ptr<Command> m_parent;
 };
@@ -0,0 +1,118 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <ostream>
+#include <string>
+
+// Read-only view of one whole, NUL terminated line, typically a line of a
+// ResponseBuffer. Offers the std::string lookups the response parsers use
+// without copying; substr() is the only call that allocates.
+class LineView
+{
+public:
+    static const size_t npos = std::string::npos;
+
+    LineView() : mData(""), mSize(0) {}
+    LineView(const char *data, size_t size) : mData(data), mSize(size) {}
+    LineView(const std::string &str) : mData(str.c_str()), mSize(str.size()) {}
+
+    const char* c_str() const { return mData; }
+    size_t size() const { return mSize; }
+    bool empty() const { return !mSize; }
+    char operator[](size_t pos) const { return mData[pos]; }
+
+    size_t find(const char *needle, size_t pos = 0) const
+    {
+        size_t length = strlen(needle);
+        if (pos > mSize || length > mSize - pos)
+            return npos;
+        for (size_t i = pos; i + length <= mSize; i++)
+        {
+            if (!memcmp(mData + i, needle, length))
+                return i;
+        }
+        return npos;
+    }
+
+    size_t find(char c, size_t pos = 0) const
+    {
+        if (pos >= mSize)
+            return npos;
+        const void *found = memchr(mData + pos, c, mSize - pos);
+        return found ? static_cast<const char*>(found) - mData : npos;
+    }
+
+    size_t find_first_of(char c, size_t pos = 0) const { return find(c, pos); }
+
+    size_t find_last_of(char c) const
+    {
+        for (size_t i = mSize; i > 0; i--)
+        {
+            if (mData[i - 1] == c)
+                return i - 1;
+        }
+        return npos;
+    }
+
+    size_t find_first_not_of(const char *set, size_t pos = 0) const
+    {
+        for (size_t i = pos; i < mSize; i++)
+        {
+            if (!strchr(set, mData[i]))
+                return i;
+        }
+        return npos;
+    }
+
+    size_t find_first_not_of(char c, size_t pos = 0) const
+    {
+        for (size_t i = pos; i < mSize; i++)
+        {
+            if (mData[i] != c)
+                return i;
+        }
+        return npos;
+    }
+
+    std::string substr(size_t pos, size_t count = npos) const
+    {
+        if (pos > mSize)
+            return std::string();
+        return std::string(mData + pos, count < mSize - pos ? count : mSize - pos);
+    }
+
+    std::string str() const { return std::string(mData, mSize); }
+
+    bool operator==(const LineView &other) const
+    {
+        return mSize == other.mSize && !memcmp(mData, other.mData, mSize);
+    }
+    bool operator!=(const LineView &other) const { return !(*this == other); }
+
+private:
+    const char *mData;
+    size_t mSize;
+};
+
+inline std::ostream& operator<<(std::ostream &os, const LineView &line)
+{
+    return os.write(line.c_str(), line.size());
+}
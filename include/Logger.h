@@ -16,12 +16,76 @@
 
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
 #include <PmLog.h>
 
 extern pmlog::PmLog appLog;
 
-#define AppLogDebug() appLog.debug()
-#define AppLogInfo() appLog.info()
-#define AppLogWarning() appLog.warning()
-#define AppLogError() appLog.error()
-#define AppLogCritical() appLog.critical()
+enum AppLogLevel {
+    APP_LOG_LEVEL_DEBUG,
+    APP_LOG_LEVEL_INFO,
+    APP_LOG_LEVEL_WARNING,
+    APP_LOG_LEVEL_ERROR,
+    APP_LOG_LEVEL_CRITICAL
+};
+
+// Levels below this are compiled out, set with -DAPP_LOG_MIN_LEVEL
+#ifndef APP_LOG_MIN_LEVEL
+#define APP_LOG_MIN_LEVEL APP_LOG_LEVEL_DEBUG
+#endif
+
+// Sets the level of the PmLog context, like PmLogCtl does
+bool appLogSetLevel(const char *name);
+// Whether the PmLog context currently writes messages of the level
+bool appLogContextEnabled(int level);
+
+inline bool appLogEnabled(int level)
+{
+    return level >= APP_LOG_MIN_LEVEL && appLogContextEnabled(level);
+}
+
+// Lets a disabled log statement collapse into a void expression so the
+// message is neither formatted nor evaluated.
+struct AppLogVoidify {
+    template <typename T>
+    void operator&(const T&) const {}
+};
+
+// One per call site of a rate limited statement
+class AppLogRateLimit {
+public:
+    bool allow(int intervalMs)
+    {
+        int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+        int64_t next = mNext.load(std::memory_order_relaxed);
+        return now >= next && mNext.compare_exchange_strong(next, now + intervalMs, std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<int64_t> mNext{0};
+};
+
+#define APP_LOG_IF(level, stream) \
+    !appLogEnabled(level) ? (void) 0 : AppLogVoidify() & stream
+
+// The lambda gives every call site its own limiter
+#define APP_LOG_EVERY(level, intervalMs, stream) \
+    !appLogEnabled(level) || !([]() -> AppLogRateLimit& { static AppLogRateLimit limit; return limit; }().allow(intervalMs)) \
+        ? (void) 0 : AppLogVoidify() & stream
+
+#define AppLogDebug() APP_LOG_IF(APP_LOG_LEVEL_DEBUG, appLog.debug())
+#define AppLogInfo() APP_LOG_IF(APP_LOG_LEVEL_INFO, appLog.info())
+#define AppLogWarning() APP_LOG_IF(APP_LOG_LEVEL_WARNING, appLog.warning())
+#define AppLogError() APP_LOG_IF(APP_LOG_LEVEL_ERROR, appLog.error())
+#define AppLogCritical() APP_LOG_IF(APP_LOG_LEVEL_CRITICAL, appLog.critical())
+
+// For messages that can fire once per frame or response: at most one
+// message per interval from each call site.
+#define AppLogDebugEvery(intervalMs) APP_LOG_EVERY(APP_LOG_LEVEL_DEBUG, intervalMs, appLog.debug())
+#define AppLogInfoEvery(intervalMs) APP_LOG_EVERY(APP_LOG_LEVEL_INFO, intervalMs, appLog.info())
+#define AppLogWarningEvery(intervalMs) APP_LOG_EVERY(APP_LOG_LEVEL_WARNING, intervalMs, appLog.warning())
+#define AppLogErrorEvery(intervalMs) APP_LOG_EVERY(APP_LOG_LEVEL_ERROR, intervalMs, appLog.error())
@@ -70,6 +70,7 @@
 #define PROP(name, type)                              "\"" #name "\":{\"type\":\"" #type "\"}"
 #define PROP_WITH_VAL_1(name, type, v1)               "\"" #name "\":{\"type\":\"" #type "\", \"enum\": [" #v1 "]}"
 #define PROP_WITH_VAL_2(name, type, v1, v2)           "\"" #name "\":{\"type\":\"" #type "\", \"enum\": [" #v1 ", " #v2 "]}"
+#define PROP_WITH_VAL_3(name, type, v1, v2, v3)       "\"" #name "\":{\"type\":\"" #type "\", \"enum\": [" #v1 ", " #v2 ", " #v3 "]}"
 #define ARRAY(name, type)                             "\"" #name "\":{\"type\":\"array\", \"items\":{\"type\":\"" #type "\"}}"
 #define OBJARRAY(name, objschema)                     "\"" #name "\":{\"type\":\"array\", \"items\": " objschema "}"
 #define OBJSCHEMA_1(param)                            "{\"type\":\"object\",\"properties\":{" param "}}"
@@ -112,6 +113,30 @@ inline bool parsePayload(const std::string &payload, pbnjson::JValue &object)
 }
 
 
+inline bool parsePayload(const std::string &payload, pbnjson::JValue &object, const pbnjson::JSchema &schema, int *error)
+{
+	pbnjson::JDomParser parser;
+
+	if (!parser.parse(payload, schema))
+	{
+		if (strstr(parser.getError(), "parse error") != NULL)
+		{
+			// notify this is a schema error, so that caller can make further
+			// checks for throwing custom errors (particular key missing, etc)
+			pbnjson::JSchema parseSchema = pbnjson::JSchema::AllSchema();
+			if (parser.parse(payload, parseSchema))
+			{
+				*error = JSON_PARSE_SCHEMA_ERROR;
+				object = parser.getDom();
+			}
+		}
+		return false;
+	}
+
+	object = parser.getDom();
+	return true;
+}
+
 inline bool parsePayload(const std::string &payload, pbnjson::JValue &object, const std::string &schema, int *error)
 {
 	pbnjson::JSchema parseSchema = pbnjson::JSchema::AllSchema();
@@ -0,0 +1,88 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <nyx/nyx_client.h>
+
+// Every parameter name a message can carry. Names are interned once at
+// the handler boundary, the queue only compares these.
+enum ParamKey : uint8_t
+{
+    PARAM_ADAPTER,
+    PARAM_DEST_ADDRESS,
+    PARAM_TIMEOUT,
+    PARAM_CMD_NAME,
+    // sendCommand args
+    PARAM_PWR_STATE,
+    PARAM_AUD_MUTE_STATUS,
+    PARAM_VOLUME,
+    PARAM_OSD,
+    PARAM_SET_ACTIVE,
+    PARAM_ACTIVE_SOURCE,
+    PARAM_VENDOR_ID,
+    PARAM_VERSION,
+    PARAM_NAME,
+    PARAM_LANGUAGE,
+    PARAM_IS_ACTIVE,
+    PARAM_PAYLOAD,
+    // getConfig / setConfig keys not listed above
+    PARAM_CONFIG_VENDOR_ID,
+    PARAM_POWER_STATE,
+    PARAM_PHYSICAL_ADDRESS,
+    PARAM_LOGICAL_ADDRESS,
+    PARAM_DEVICE_TYPE,
+    PARAM_KEY_COUNT
+};
+
+// Four fixed params plus the five system-information args
+const size_t MAX_MESSAGE_PARAMS = 10;
+
+const char* paramKeyName(ParamKey key);
+bool findParamKey(const std::string &name, ParamKey &key);
+
+// Fixed capacity parameter list kept inline in MessageData. Parameters
+// stay in the order they were first set, which is the order nyx gets them.
+class MessageParams
+{
+public:
+    struct Param
+    {
+        ParamKey key;
+        std::string value;
+    };
+
+    // Replaces the value of a key already set, false when the list is full
+    bool set(ParamKey key, std::string value);
+    const std::string* get(ParamKey key) const;
+    std::string* get(ParamKey key);
+    bool has(ParamKey key) const { return get(key) != nullptr; }
+
+    size_t size() const { return mSize; }
+    const Param* begin() const { return mParams; }
+    const Param* end() const { return mParams + mSize; }
+
+    // Fills the param entries of a nyx command, false if they do not fit
+    bool writeTo(nyx_cec_command_t &command) const;
+
+private:
+    Param mParams[MAX_MESSAGE_PARAMS];
+    size_t mSize = 0;
+};
@@ -25,45 +25,223 @@
 #include <glib.h>
 #include <functional>
 #include <unistd.h>
-#include <unordered_map>
+#include <deque>
+#include <atomic>
+#include <chrono>
 #include "Logger.h"
 #include "Command.h"
+#include "CecFrame.h"
+#include "BusScheduler.h"
+#include "LockFreeQueue.h"
+#include "MessageParams.h"
+#include "ResponseBuffer.h"
+#include "ResponseWorker.h"
+#include "NyxTrace.h"
 #include <nyx/nyx_client.h>
 
 
-typedef std::function<void(CommandType, std::vector<std::string>)> MsgCallback;
+
+// <User Control Pressed>/<Released> frame for the key lane
+struct KeyFrame
+{
+    std::string adapter;
+    uint8_t destination = 0;
+    uint8_t keyCode = 0;
+    bool pressed = true;
+};
+
+// Dispatch classes, lower goes first. Within a class the message with the
+// earliest deadline goes first.
+enum MessagePriority
+{
+    PRIORITY_CONTROL,
+    PRIORITY_QUERY,
+    PRIORITY_SCAN,
+    PRIORITY_BACKGROUND
+};
+
+// Handed to the callback instead of a backend reply when a message is
+// dropped because it can no longer be sent before its deadline.
+const std::string RESPONSE_DEADLINE_EXCEEDED = "response: deadline exceeded";
 
 struct MessageData
 {
     CommandType type;
-    std::unordered_map<std::string, std::string> params;
+    MessageParams params;
+    // SEND_FRAME only, the frame bypasses params
+    std::string adapter;
+    CecFrame frame;
+    // Request the message was created for, handed back with its response
+    std::shared_ptr<Command> command;
+    // Logical address the message is directed to, -1 if none
+    int destination = -1;
+    int attempts = 0;
+    // Commands merged into this message, answered with its response
+    std::vector<std::shared_ptr<Command>> waiters;
+    // Net set-volume steps still to send, positive is up
+    int volumeSteps = 0;
+    MessagePriority priority = PRIORITY_QUERY;
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+    // Set once the message has been handed to the backend
+    bool dispatched = false;
+    // Scan probe, an address without a device is the expected answer and
+    // says nothing about the health of a device
+    bool probe = false;
+
+    // True once every command waiting on the message was cancelled
+    bool isCancelled() const
+    {
+        if (!command || !command->isCancelled())
+            return false;
+        for (const auto &waiter : waiters)
+        {
+            if (!waiter->isCancelled())
+                return false;
+        }
+        return true;
+    }
 };
 
+typedef ResponseHandler MsgCallback;
+
+// How the queue is driven. The thread engine dispatches on its own thread
+// and parses responses on a worker. The loop engine does both on the main
+// loop, woken through an eventfd, and starts no threads of its own.
+enum DispatchEngine
+{
+    DISPATCH_ENGINE_THREAD,
+    DISPATCH_ENGINE_LOOP
+};
+
+// Unsolicited frame and the adapter it was heard on
+typedef std::function<void(const std::string &adapter, const CecFrame&)> EventCallback;
+
 class MessageQueue
 {
 public:
     MessageQueue();
+    // Extra engine for one more adapter. It sends through the nyx device
+    // of primary, always runs its own dispatch thread and is not traced.
+    // Its replies are matched to its sends by the primary.
+    explicit MessageQueue(MessageQueue *primary);
     ~MessageQueue();
     void addMessage(std::shared_ptr<MessageData>);
+    // Key frames skip the message queue and go out before any queued message.
+    bool sendKey(const KeyFrame &key);
+    // Sends the press now and repeats it every interval until another key
+    // event arrives or the timeout expires, which sends the release.
+    bool holdKey(const KeyFrame &key, std::chrono::milliseconds interval, std::chrono::milliseconds timeout);
     void setCallback(MsgCallback);
+    // Unsolicited frames are delivered here on the main loop, never through
+    // the command callback.
+    void setEventCallback(EventCallback);
+    std::vector<BusStatus> getBusStatus();
     static void nyxCallback(nyx_cec_response_t *);
+    // Set from the command line before the first queue is created
+    static void setEngine(DispatchEngine engine) { sEngine = engine; }
+    static DispatchEngine getEngine() { return sEngine; }
 
 private:
     void dispatchMessage();
+    bool isReady(std::chrono::steady_clock::time_point now) const;
+    std::chrono::steady_clock::time_point nextWakeup() const;
+    void dispatchStep(std::unique_lock<std::mutex> &lock);
+    void wake();
+    void deliverResponse(ResponseBuffer);
+    void runLoopStep();
+    static gboolean wakeCb(GIOChannel *channel, GIOCondition condition, gpointer data);
+    static gboolean timerCb(gpointer data);
     bool handleMessage(std::shared_ptr<MessageData>);
     void init();
+    bool coalesce(const std::shared_ptr<MessageData> &);
+    bool nextVolumeStep(const std::shared_ptr<MessageData> &, const ResponseBuffer &);
     void sendCommand(std::shared_ptr<MessageData>);
+    void sendFrame(std::shared_ptr<MessageData>);
+    void submitCommand(std::shared_ptr<MessageData> request, nyx_cec_command_t &command);
+    void initKeyCommand();
+    void sendKeyFrame(const KeyFrame &key);
+    bool paceMessage(const MessageData &request, std::chrono::steady_clock::time_point now);
+    bool hasBusTime(const MessageData &request, std::chrono::steady_clock::time_point now) const;
+    std::vector<std::shared_ptr<MessageData>>::iterator nextMessage(std::chrono::steady_clock::time_point now,
+            std::vector<std::shared_ptr<MessageData>> &expired);
+    void repeatHeldKey(std::chrono::steady_clock::time_point now);
     void getConfig(std::shared_ptr<MessageData>);
     void setConfig(std::shared_ptr<MessageData>);
-
+    void onResponse(ResponseBuffer);
+    void respond(std::shared_ptr<MessageData>, ResponseBuffer);
+    void respondTraced(std::shared_ptr<MessageData>, ResponseBuffer);
+    bool postEvents(const ResponseBuffer &);
+    static gboolean drainEvents(gpointer);
+    void pushInFlight(std::shared_ptr<MessageData>);
+    void popInFlight();
+    bool traceConfig(std::shared_ptr<MessageData> request, const char *name, const char *key, const char *value);
 
     std::vector<std::shared_ptr<MessageData>> mQueue;
     std::thread mThread;
     std::mutex mMutex;
     std::condition_variable mCondVar;
     bool mQuit;
+    static const size_t KEY_LANE_SIZE = 16;
+    KeyFrame mKeyLane[KEY_LANE_SIZE];
+    size_t mKeyHead = 0;
+    size_t mKeyCount = 0;
+    nyx_cec_command_t mKeyCommand;
+    std::shared_ptr<MessageData> mKeyMessage;
+    struct HeldKey
+    {
+        bool active = false;
+        KeyFrame frame;
+        std::chrono::milliseconds interval;
+        std::chrono::steady_clock::time_point next;
+        std::chrono::steady_clock::time_point until;
+    } mHeldKey;
+    BusScheduler mBus;
+    // Per adapter, queued messages for it wait until then for bus time
+    std::map<std::string, std::chrono::steady_clock::time_point> mBusReadyAt;
     MsgCallback mCb;
+    // Parses responses and completes commands off the bus facing threads
+    ResponseWorker mWorker;
+    EventCallback mEventCb;
+    struct InFlight
+    {
+        // Engine the reply goes to, null once it is gone
+        MessageQueue *engine;
+        std::shared_ptr<MessageData> request;
+    };
+    // Messages handed to nyx by every engine on the device, in send order,
+    // awaiting their reply. Only used on the primary, nyx has one reply
+    // stream per device.
+    std::deque<InFlight> mInFlight;
+    std::mutex mInFlightMutex;
+    // Signalled when a reply was handed to its engine
+    std::condition_variable mDeliveredCond;
+    // Replies being handed to this engine, it is not destroyed before they
+    // are. Guarded by the primary's mInFlightMutex.
+    int mDelivering = 0;
+    // Held across each send so the order of mInFlight is the send order
+    std::mutex mSendMutex;
+    struct Event
+    {
+        std::string adapter;
+        CecFrame frame;
+    };
+    LockFreeQueue<Event, 64> mEvents;
+    std::atomic<bool> mEventsScheduled;
     nyx_device_handle_t mDevice;
+    // Engine that owns the in-flight list, this one unless it is an extra
+    MessageQueue *mPrimary;
+    // False for extra engines, the primary opens and closes nyx
+    bool mOwnsDevice = true;
+    std::unique_ptr<NyxTraceRecorder> mRecorder;
+    std::unique_ptr<NyxTracePlayer> mPlayer;
+    static DispatchEngine sEngine;
+    DispatchEngine mEngine;
+    // Loop engine: wakeup eventfd, its watch, the timed work timer and
+    // responses waiting for the main loop
+    int mWakeFd = -1;
+    guint mWakeWatch = 0;
+    guint mTimer = 0;
+    LockFreeQueue<ResponseBuffer, 16> mResponses;
 
 };
 
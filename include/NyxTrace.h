@@ -0,0 +1,119 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <nyx/nyx_client.h>
+
+#include "ResponseBuffer.h"
+
+enum NyxTraceMode {
+    NYX_TRACE_OFF,
+    NYX_TRACE_RECORD,
+    NYX_TRACE_REPLAY,
+    NYX_TRACE_REPLAY_FAST
+};
+
+enum NyxTraceRecordKind : uint8_t {
+    NYX_TRACE_COMMAND = 1,
+    NYX_TRACE_RESPONSE = 2
+};
+
+// Process wide trace settings, set from the command line before the
+// service creates its message queue.
+class NyxTrace {
+public:
+    static void configure(NyxTraceMode mode, const std::string &path);
+    static NyxTraceMode getMode() { return sMode; }
+    static const std::string& getPath() { return sPath; }
+
+private:
+    static NyxTraceMode sMode;
+    static std::string sPath;
+};
+
+// Appends every command handed to nyx and every response delivered back
+// to a compact binary file:
+//   header : "CECTRACE" u16 version
+//   record : u8 kind, u64 timestamp (us since start), u32 body length, body
+// Command bodies hold the nyx command name and its params, response bodies
+// the response lines. All strings are u16 length prefixed, little endian.
+class NyxTraceRecorder {
+public:
+    explicit NyxTraceRecorder(const std::string &path);
+    ~NyxTraceRecorder();
+    bool isOpen() const { return mFile != nullptr; }
+    void recordCommand(const nyx_cec_command_t &command);
+    void recordResponse(const ResponseBuffer &resp);
+
+private:
+    void writeRecord(NyxTraceRecordKind kind, const std::string &body);
+
+    FILE *mFile;
+    std::mutex mMutex;
+    std::chrono::steady_clock::time_point mStart;
+};
+
+typedef std::function<void(ResponseBuffer)> NyxReplayCallback;
+
+// Stands in for nyx: every command consumes the next command record of the
+// trace and the responses recorded after it are fed back, either with their
+// original delay relative to the command or as fast as possible.
+class NyxTracePlayer {
+public:
+    NyxTracePlayer(const std::string &path, bool realTime, NyxReplayCallback cb);
+    ~NyxTracePlayer();
+    bool isOpen() const { return mLoaded; }
+    void replayCommand(const nyx_cec_command_t &command);
+
+private:
+    struct Record {
+        NyxTraceRecordKind kind;
+        uint64_t timestamp;
+        std::string name;
+        std::vector<std::string> lines;
+    };
+
+    struct Pending {
+        std::chrono::steady_clock::time_point due;
+        ResponseBuffer response;
+    };
+
+    bool load(const std::string &path);
+    void deliverLoop();
+
+    std::vector<Record> mRecords;
+    size_t mCursor = 0;
+    bool mRealTime;
+    bool mLoaded = false;
+    NyxReplayCallback mCb;
+
+    std::list<Pending> mPending;
+    std::thread mThread;
+    std::mutex mMutex;
+    std::condition_variable mCondVar;
+    bool mQuit = false;
+};
@@ -0,0 +1,145 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <utility>
+
+// Blocks kept per size class once released, the rest go back to the heap
+const size_t POOL_MAX_FREE_BLOCKS = 64;
+
+#ifdef ENABLE_ALLOC_STATS
+// Counts of pooled allocations served from a free list and from the heap.
+// Once the pools are warm the heap count should stop growing.
+struct AllocStats {
+    static std::atomic<uint64_t> poolHits;
+    static std::atomic<uint64_t> heapAllocs;
+    static void log();
+};
+#define ALLOC_STAT(counter) AllocStats::counter.fetch_add(1, std::memory_order_relaxed)
+#else
+#define ALLOC_STAT(counter) do {} while (0)
+#endif
+
+// Free list of fixed size blocks shared by every pooled type of the same
+// size class. Blocks are allocated and released from both the main loop
+// and the message queue thread, hence the lock. The pool is never
+// destroyed so objects released during exit stay valid.
+template <size_t Size>
+class BlockPool {
+public:
+    static BlockPool& instance()
+    {
+        static BlockPool *pool = new BlockPool();
+        return *pool;
+    }
+
+    void* allocate()
+    {
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            if (mFree) {
+                Block *block = mFree;
+                mFree = block->next;
+                mFreeCount--;
+                ALLOC_STAT(poolHits);
+                return block;
+            }
+        }
+        ALLOC_STAT(heapAllocs);
+        return ::operator new(Size);
+    }
+
+    void deallocate(void *ptr)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            if (mFreeCount < POOL_MAX_FREE_BLOCKS) {
+                Block *block = static_cast<Block*>(ptr);
+                block->next = mFree;
+                mFree = block;
+                mFreeCount++;
+                return;
+            }
+        }
+        ::operator delete(ptr);
+    }
+
+private:
+    struct Block {
+        Block *next;
+    };
+
+    static_assert(Size >= sizeof(Block), "block too small for the free list");
+
+    BlockPool() = default;
+
+    Block *mFree = nullptr;
+    size_t mFreeCount = 0;
+    std::mutex mMutex;
+};
+
+constexpr size_t poolBlockSize(size_t size)
+{
+    return (size + 15) & ~static_cast<size_t>(15);
+}
+
+// Allocator for std::allocate_shared. Single objects, which includes the
+// object and its control block, come from the pool of their size class.
+template <typename T>
+class PoolAllocator {
+public:
+    typedef T value_type;
+
+    PoolAllocator() = default;
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U>&) {}
+
+    T* allocate(size_t n)
+    {
+        static_assert(alignof(T) <= alignof(std::max_align_t), "over aligned types can not be pooled");
+        if (n != 1)
+            return static_cast<T*>(::operator new(n * sizeof(T)));
+        return static_cast<T*>(BlockPool<poolBlockSize(sizeof(T))>::instance().allocate());
+    }
+
+    void deallocate(T *ptr, size_t n)
+    {
+        if (n != 1)
+            ::operator delete(ptr);
+        else
+            BlockPool<poolBlockSize(sizeof(T))>::instance().deallocate(ptr);
+    }
+};
+
+template <typename T, typename U>
+bool operator==(const PoolAllocator<T>&, const PoolAllocator<U>&) { return true; }
+template <typename T, typename U>
+bool operator!=(const PoolAllocator<T>&, const PoolAllocator<U>&) { return false; }
+
+// Drop-in for std::make_shared on the request path
+template <typename T, typename... Args>
+std::shared_ptr<T> makePooled(Args&&... args)
+{
+    return std::allocate_shared<T>(PoolAllocator<T>(), std::forward<Args>(args)...);
+}
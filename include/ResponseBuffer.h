@@ -0,0 +1,83 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <nyx/nyx_client.h>
+
+#include "LineView.h"
+
+// All lines of one backend response in a single block:
+//   u32 offsets[lines + 1] followed by the NUL terminated lines.
+// Move only, handed down the response path by value or const reference so
+// a response costs one allocation however many lines it has.
+class ResponseBuffer
+{
+public:
+    class const_iterator
+    {
+    public:
+        const_iterator(const ResponseBuffer *buffer, size_t index) : mBuffer(buffer), mIndex(index) {}
+        LineView operator*() const { return mBuffer->line(mIndex); }
+        const_iterator& operator++() { mIndex++; return *this; }
+        bool operator==(const const_iterator &other) const { return mIndex == other.mIndex; }
+        bool operator!=(const const_iterator &other) const { return mIndex != other.mIndex; }
+
+    private:
+        const ResponseBuffer *mBuffer;
+        size_t mIndex;
+    };
+
+    ResponseBuffer() = default;
+    explicit ResponseBuffer(const nyx_cec_response_t &response);
+    explicit ResponseBuffer(const std::vector<std::string> &lines);
+    // Single line replies made up by the queue itself
+    explicit ResponseBuffer(const char *line);
+
+    ResponseBuffer(ResponseBuffer &&other) : mBlock(std::move(other.mBlock)), mLines(other.mLines)
+    {
+        other.mLines = 0;
+    }
+    ResponseBuffer& operator=(ResponseBuffer &&other)
+    {
+        mBlock = std::move(other.mBlock);
+        mLines = other.mLines;
+        other.mLines = 0;
+        return *this;
+    }
+    ResponseBuffer(const ResponseBuffer&) = delete;
+    ResponseBuffer& operator=(const ResponseBuffer&) = delete;
+
+    size_t size() const { return mLines; }
+    bool empty() const { return !mLines; }
+    LineView line(size_t index) const;
+    LineView front() const { return line(0); }
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, mLines); }
+
+private:
+    template <typename GetLine>
+    void build(size_t count, GetLine getLine);
+    uint32_t* offsets() const { return reinterpret_cast<uint32_t*>(mBlock.get()); }
+
+    std::unique_ptr<char[]> mBlock;
+    size_t mLines = 0;
+};
@@ -0,0 +1,78 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "LockFreeQueue.h"
+#include "ResponseBuffer.h"
+
+struct MessageData;
+
+typedef std::function<void(std::shared_ptr<MessageData>, ResponseBuffer)> ResponseHandler;
+
+// Responses waiting for the worker without taking a lock, beyond this they
+// go to a locked overflow list
+const size_t RESPONSE_WORKER_QUEUE_SIZE = 64;
+
+// Runs response parsing and completion on its own thread so the nyx
+// callback and the dispatch thread go straight back to the bus. Responses
+// are handled one at a time in the order they were posted.
+class ResponseWorker
+{
+public:
+    ResponseWorker();
+    ~ResponseWorker();
+
+    void setHandler(ResponseHandler handler);
+    // Without start() every response is handled on the posting thread
+    void start();
+    // Joins the thread, responses still queued are dropped
+    void stop();
+    // From any thread. Runs the handler on the caller's thread if the
+    // worker is not running.
+    void post(std::shared_ptr<MessageData> request, ResponseBuffer response);
+
+private:
+    struct Job
+    {
+        std::shared_ptr<MessageData> request;
+        ResponseBuffer response;
+    };
+
+    void run();
+
+    ResponseHandler mHandler;
+    LockFreeQueue<Job, RESPONSE_WORKER_QUEUE_SIZE> mJobs;
+    // Jobs posted while mJobs was full, and every one after them until the
+    // worker takes the list, so nothing overtakes them. Guarded by mMutex.
+    std::deque<Job> mOverflow;
+    std::atomic<bool> mOverflowing;
+    // Jobs pushed and not yet popped, the worker sleeps while it is 0
+    std::atomic<int> mPending;
+    std::atomic<bool> mRunning;
+    std::mutex mMutex;
+    std::condition_variable mCondVar;
+    std::thread mThread;
+};
@@ -30,6 +30,7 @@
 #include <future>
 
 typedef CecHandler* (*CreateCecHandlerObject)();
+typedef std::function<void(const std::string &adapter, const CecFrame&)> CecEventListener;
 
 class CecController {
 protected:
@@ -39,9 +40,12 @@ protected:
 
   std::list<CecHandler*> mHandlerList;
   std::list<std::pair<CreateCecHandlerObject, HandlerRank>> mCreatorList;
+  std::list<CecEventListener> mEventListeners;
   bool mInitlialized = false;
 
   static CecController *mInstance;
+
+  void WaitForInitialization();
 public:
 
   static CecController* getInstance();
@@ -51,6 +55,11 @@ public:
   virtual bool HandleCommand(std::shared_ptr<Command> command);
   virtual bool Register(CreateCecHandlerObject createObject, HandlerRank rank);
   virtual std::shared_ptr<CecDevice> GetDeviceInfo(std::string destAddress);
+  virtual HandlerErrorCode SendKey(const SendKeyReqData &keyData);
+  virtual HandlerErrorCode GetBusStatus(std::vector<BusStatus> &status);
+  virtual HandlerErrorCode GetTopology(const std::string &adapter, CecTopology &topology);
+  virtual void AddEventListener(CecEventListener listener);
+  virtual void NotifyEvent(const std::string &adapter, const CecFrame &frame);
   std::future<bool> m_InitFut;
 };
 #endif /* _CECHANDLER_H_ */
@@ -24,6 +24,8 @@
 #include <memory>
 #include <vector>
 #include "Command.h"
+#include "BusScheduler.h"
+#include "CecTopology.h"
 
 
 enum HandlerRank {
@@ -38,6 +40,9 @@ enum HandlerErrorCode {
   HANDLER_ERROR_INVALID_COMMAND,
   HANDLER_ERROR_INVALID_ADAPTER,
   HANDLER_ERROR_INVALID_DESTINATION,
+  HANDLER_ERROR_DESTINATION_UNAVAILABLE,
+  // Not in the device table yet, the command asked for discovery
+  HANDLER_ERROR_DESTINATION_UNKNOWN,
   HANDLER_ERROR_UNKNOWN
 };
 
@@ -51,5 +56,8 @@ public:
   virtual HandlerRank GetRank() = 0;
   virtual std::shared_ptr<CecDevice> GetDeviceInfo(std::string destAddress) { return std::shared_ptr<CecDevice>(); }
   virtual HandlerErrorCode ValidateCommand(std::shared_ptr<Command> command) { return HANDLER_ERROR_OK; }
+  virtual HandlerErrorCode SendKey(const SendKeyReqData &keyData) { return HANDLER_ERROR_INVALID_COMMAND; }
+  virtual HandlerErrorCode GetBusStatus(std::vector<BusStatus> &status) { return HANDLER_ERROR_INVALID_COMMAND; }
+  virtual HandlerErrorCode GetTopology(const std::string &adapter, CecTopology &topology) { return HANDLER_ERROR_INVALID_COMMAND; }
 };
 #endif /* _CECHANDLER_H_ */
@@ -18,20 +18,34 @@
 #define _DEFAULTCECHANDLER_H_
 
 #include <vector>
+#include <map>
 #include <mutex>
 
+#include "CapabilityCache.h"
 #include "CecHandler.h"
 #include "CecController.h"
+#include "CecTopology.h"
 #include "MessageQueue.h"
+#include "RetryPolicy.h"
+#include "TopologyRefresher.h"
+
+struct IncrementalScan;
+struct ReplyWait;
+struct ScanAllContext;
+struct ScanProbe;
 
 class DefaultCecHandler : public CecHandler
 {
   private:
     static bool mIsObjRegistered;
-    static std::list<std::shared_ptr<Command>> mCmdList;
     static std::mutex mMutex;
     static std::list<CecDevice> mDeviceInfoList;
     static std::list<std::string> mAdaptersList;
+    // HDMI tree per adapter, follows mDeviceInfoList
+    static std::map<std::string, CecTopology> mTopologies;
+    // Requests acknowledged without their reply, until it comes as an event
+    static std::mutex mReplyWaitsMutex;
+    static std::list<std::shared_ptr<ReplyWait>> mReplyWaits;
     HandlerRank mRank = DEFAULT_RANK;
 
     DefaultCecHandler();
@@ -43,30 +57,78 @@ class DefaultCecHandler : public CecHandler
     }
 
     bool HandleSendCommand(std::shared_ptr<Command> command);
+    static MessagePriority GetCommandPriority(const CecCommand &command);
+    static bool GetCommandOpcode(const CecCommand &command, uint8_t &opcode);
+    static bool GetCapabilityKey(const std::string &adapter, int logicalAddress, std::string &vendor, uint16_t &physical);
+    static bool FailKnownUnsupported(std::shared_ptr<Command> command, const std::string &adapter, int destination,
+                                     uint8_t opcode);
+    static void LearnCapability(const std::string &adapter, const CecFrame &frame, bool hasReply, const CecFrame &reply,
+                                int32_t timeout);
+    static void MatchReplyWaits(const std::string &adapter, const CecFrame &frame);
+    static gboolean ReplyTimeoutCb(gpointer data);
     bool HandleScan(std::shared_ptr<Command> command);
+    void HandleScanAll(std::shared_ptr<Command> command);
+    static gboolean ScanAllTimeoutCb(gpointer data);
+    static void AnswerScanAll(std::shared_ptr<ScanAllContext> ctx);
+    void StartScan(std::shared_ptr<Command> command, const std::string &adapter, bool incremental);
+    void QueueScan(std::shared_ptr<Command> command, const std::string &adapter, MessagePriority priority);
+    void HandleIncrementalScan(std::shared_ptr<Command> command, const std::string &adapter);
+    void ProbeAddresses(std::shared_ptr<Command> command, const std::string &adapter, int onlyAddress, bool unknownOnly,
+                        MessagePriority priority, std::function<void(std::shared_ptr<ScanResData>, bool)> done);
+    void RefreshTopology(bool full);
+    void TrackTopologyEvent(const CecFrame &frame);
+    void DiscoverDestination(std::shared_ptr<Command> command);
+    static gboolean DiscoveryDoneCb(gpointer data);
+    void SendProbe(std::shared_ptr<ScanProbe> probe, const CecFrame &frame);
+    void HandleProbeReply(std::shared_ptr<ScanProbe> probe, std::shared_ptr<SendFrameResData> resp);
+    void NextProbeStep(std::shared_ptr<ScanProbe> probe);
+    static void FinishProbe(std::shared_ptr<ScanProbe> probe, bool found);
+    static void FinishIncrementalScan(std::shared_ptr<IncrementalScan> scan);
+    MessageQueue& GetScanQueue(const std::string &adapter);
+    MessageQueue& GetQueue(const MessageData &msgData);
     bool HandleListAdapters(std::shared_ptr<Command> command);
     bool HandleGetConfig(std::shared_ptr<Command> command);
     bool HandleSetConfig(std::shared_ptr<Command> command);
+    bool HandleSendFrame(std::shared_ptr<Command> command);
 
     HandlerErrorCode ValidateAdapter(std::string adapter);
-    HandlerErrorCode ValidateAddress(std::string address);
+    HandlerErrorCode ValidateAddress(const std::string &adapter, const std::string &address);
+    int ResolveLogicalAddress(const std::string &adapter, const std::string &address);
     HandlerErrorCode ValidateSendCommand(std::shared_ptr<Command> command);
     HandlerErrorCode ValidateListAdapters(std::shared_ptr<Command> command);
     HandlerErrorCode ValidateScan(std::shared_ptr<Command> command);
     HandlerErrorCode ValidateGetConfig(std::shared_ptr<Command> command);
     HandlerErrorCode ValidateSetConfig(std::shared_ptr<Command> command);
+    HandlerErrorCode ValidateSendFrame(std::shared_ptr<Command> command);
 
-    static void HandleSystemInfoResp(std::shared_ptr<SendCommandReqData> commandData, std::vector<std::string> resp, std::shared_ptr<SendCommandResData> respCmd);
-    static std::string GetValue(std::string str);
-    static void HandleMessageCb(CommandType type, std::vector<std::string> resp);
+    static void HandleSystemInfoResp(std::shared_ptr<SendCommandReqData> commandData, const ResponseBuffer &resp, std::shared_ptr<SendCommandResData> respCmd);
+    static std::string GetValue(const LineView &str);
+    static void RespondWithError(std::shared_ptr<Command> command, const ErrorInfo &errInfo);
+    static bool IsFailedResponse(const ResponseBuffer &resp);
+    static void HandleMessageCb(std::shared_ptr<MessageData> msgData, const ResponseBuffer &resp);
+    static void HandleCommandCb(const MessageData &msgData, std::shared_ptr<Command> command, const ResponseBuffer &resp);
+    void HandleResponse(std::shared_ptr<MessageData> msgData, ResponseBuffer resp);
+    bool ScheduleRetry(std::shared_ptr<MessageData> msgData);
+    static gboolean RetryTimeoutCb(gpointer data);
+    static void HandleEventCb(const std::string &adapter, const CecFrame &frame);
+    static void UpdateDeviceInfo(const std::string &adapter, const CecFrame &frame);
+    static void ApplyDeviceFrame(CecDevice &device, const CecFrame &frame);
+    static void RebuildTopology();
 
-    static void HandleSendCommandCb(std::vector<std::string> resp);
-    static void HandleScanCb(std::vector<std::string> resp);
-    static void HandleListAdaptersCb(std::vector<std::string> resp);
-    static void HandleGetConfigCb(std::vector<std::string> resp);
-    static void HandleSetConfigCb(std::vector<std::string> resp);
+    static void HandleSendCommandCb(std::shared_ptr<Command> command, const ResponseBuffer &resp);
+    static void HandleScanCb(std::shared_ptr<Command> command, const ResponseBuffer &resp);
+    static void HandleListAdaptersCb(std::shared_ptr<Command> command, const ResponseBuffer &resp);
+    static void HandleGetConfigCb(std::shared_ptr<Command> command, const ResponseBuffer &resp);
+    static void HandleSetConfigCb(std::shared_ptr<Command> command, const ResponseBuffer &resp);
+    static void HandleSendFrameCb(std::shared_ptr<Command> command, const ResponseBuffer &resp, bool probe);
 
+    RetryPolicy mRetry;
     MessageQueue mQueue;
+    // Scan engines for adapters other than the default one, so scans of
+    // different adapters run side by side
+    std::map<std::string, std::unique_ptr<MessageQueue>> mScanQueues;
+    std::mutex mScanQueuesMutex;
+    TopologyRefresher mRefresher;
 
   public:
     ~DefaultCecHandler();
@@ -83,6 +145,9 @@ class DefaultCecHandler : public CecHandler
     std::shared_ptr<CecDevice> GetDeviceInfo(std::string destAddress);
     HandlerRank GetRank() { return mRank; }
     HandlerErrorCode ValidateCommand(std::shared_ptr<Command> command);
+    HandlerErrorCode SendKey(const SendKeyReqData &keyData);
+    HandlerErrorCode GetBusStatus(std::vector<BusStatus> &status);
+    HandlerErrorCode GetTopology(const std::string &adapter, CecTopology &topology);
 };
 
 #endif // _DEFAULTCECHANDLER_H
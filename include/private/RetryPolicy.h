@@ -0,0 +1,80 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef _RETRYPOLICY_H_
+#define _RETRYPOLICY_H_
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <utility>
+
+#include "Command.h"
+#include "CecFrame.h"
+
+const int RETRY_BASE_DELAY_MS = 100;
+const int RETRY_MAX_DELAY_MS = 2000;
+// Consecutive failures that open the circuit for an address
+const int BREAKER_FAILURE_THRESHOLD = 3;
+const int BREAKER_COOLDOWN_MS = 5000;
+const int BREAKER_MAX_COOLDOWN_MS = 60000;
+
+// Decides whether a failed message is sent again and when, and keeps a
+// circuit breaker per adapter and logical address so that devices which
+// stopped answering (typically in standby) fail fast instead of using bus
+// time.
+class RetryPolicy
+{
+  public:
+    RetryPolicy();
+
+    // Number of resends allowed after the first attempt
+    static int GetBudget(CommandType type);
+    // Delay before the given resend, exponential with jitter
+    std::chrono::milliseconds GetBackoff(int attempt);
+
+    // False while the circuit for the address is open. Once the cooldown
+    // is over a single probe is let through.
+    bool AllowSend(const std::string &adapter, int address);
+    void RecordSuccess(const std::string &adapter, int address);
+    void RecordFailure(const std::string &adapter, int address);
+
+  private:
+    enum BreakerState {
+      BREAKER_CLOSED,
+      BREAKER_OPEN,
+      BREAKER_HALF_OPEN
+    };
+
+    struct Breaker {
+      BreakerState state = BREAKER_CLOSED;
+      int failures = 0;
+      std::chrono::milliseconds cooldown = std::chrono::milliseconds(BREAKER_COOLDOWN_MS);
+      std::chrono::steady_clock::time_point openUntil;
+    };
+
+    static bool IsTracked(int address) { return address >= 0 && address < CEC_BROADCAST_ADDRESS; }
+    // Called with mMutex held
+    Breaker& GetBreaker(const std::string &adapter, int address);
+
+    std::map<std::pair<std::string, int>, Breaker> mBreakers;
+    std::mutex mMutex;
+    std::minstd_rand mRandom;
+};
+
+#endif // _RETRYPOLICY_H_
@@ -0,0 +1,68 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+#ifndef _TOPOLOGYREFRESHER_H_
+#define _TOPOLOGYREFRESHER_H_
+
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <glib.h>
+
+const int TOPOLOGY_REFRESH_MIN_MS = 10000;
+const int TOPOLOGY_REFRESH_MAX_MS = 600000;
+// Delay of the refresh following a hot-plug announcement
+const int TOPOLOGY_HOTPLUG_DELAY_MS = 2000;
+
+// Keeps the device table warm without clients scanning. After adapter
+// discovery it asks for one full scan, then for incremental refreshes
+// whose interval doubles while nothing changes and drops back to the
+// minimum on churn or hot-plug. Nothing is scheduled while the bus is in
+// standby.
+class TopologyRefresher
+{
+  public:
+    // Runs on the main loop, full is set for the first refresh only.
+    // RefreshDone() has to follow once the refresh finished.
+    typedef std::function<void(bool full)> RefreshFunction;
+
+    explicit TopologyRefresher(RefreshFunction refresh);
+    ~TopologyRefresher();
+
+    void Start();
+    void RefreshDone(bool changed);
+    void NotifyHotPlug();
+    void SetStandby(bool standby);
+
+  private:
+    static gboolean TimeoutCb(gpointer data);
+    // Called with mMutex held
+    void Schedule(std::chrono::milliseconds delay);
+
+    RefreshFunction mRefresh;
+    std::mutex mMutex;
+    guint mTimer = 0;
+    std::chrono::milliseconds mInterval;
+    bool mStarted = false;
+    bool mFullDone = false;
+    bool mRefreshing = false;
+    bool mStandby = false;
+    // Hot-plug seen while a refresh was running
+    bool mHotPlugPending = false;
+};
+
+#endif // _TOPOLOGYREFRESHER_H_
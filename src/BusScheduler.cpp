@@ -0,0 +1,117 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include <algorithm>
+
+#include "BusScheduler.h"
+
+static int64_t toSlot(std::chrono::steady_clock::duration since)
+{
+    return std::chrono::duration_cast<std::chrono::seconds>(since).count();
+}
+
+BusScheduler::Bucket& BusScheduler::refill(const std::string &adapter, Clock::time_point now)
+{
+    auto it = mBuckets.find(adapter);
+    if (it == mBuckets.end()) {
+        it = mBuckets.insert(std::make_pair(adapter, Bucket())).first;
+        it->second.last = now;
+        it->second.busySlot = toSlot(now - mEpoch);
+        return it->second;
+    }
+
+    Bucket &bucket = it->second;
+    int64_t elapsed = std::chrono::duration_cast<std::chrono::microseconds>(now - bucket.last).count();
+    if (elapsed > 0) {
+        bucket.tokens = std::min(BUS_BURST_US, bucket.tokens + elapsed * BUS_TARGET_UTILIZATION_PERCENT / 100);
+        bucket.last = now;
+    }
+    return bucket;
+}
+
+void BusScheduler::account(Bucket &bucket, int64_t cost, Clock::time_point now)
+{
+    int64_t slot = toSlot(now - mEpoch);
+    for (int64_t s = bucket.busySlot + 1; s <= slot && s <= bucket.busySlot + BUS_STATS_WINDOW_SEC; s++)
+        bucket.busy[s % BUS_STATS_WINDOW_SEC] = 0;
+    if (slot > bucket.busySlot)
+        bucket.busySlot = slot;
+
+    bucket.busy[slot % BUS_STATS_WINDOW_SEC] += cost;
+    bucket.tokens -= cost;
+    bucket.framesSent++;
+}
+
+std::chrono::microseconds BusScheduler::acquire(const std::string &adapter, int64_t cost, Clock::time_point now)
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    Bucket &bucket = refill(adapter, now);
+
+    // A frame longer than the burst goes out once the bucket is full.
+    int64_t needed = std::min(cost, BUS_BURST_US);
+    if (bucket.tokens >= needed) {
+        if (bucket.deferring) {
+            bucket.deferring = false;
+            bucket.deferredTimeMs += std::chrono::duration_cast<std::chrono::milliseconds>(now - bucket.deferredSince).count();
+        }
+        account(bucket, cost, now);
+        return std::chrono::microseconds(0);
+    }
+
+    if (!bucket.deferring) {
+        bucket.deferring = true;
+        bucket.deferredSince = now;
+        bucket.deferred++;
+    }
+    return std::chrono::microseconds((needed - bucket.tokens) * 100 / BUS_TARGET_UTILIZATION_PERCENT + 1);
+}
+
+void BusScheduler::charge(const std::string &adapter, int64_t cost, Clock::time_point now)
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    Bucket &bucket = refill(adapter, now);
+    account(bucket, cost, now);
+    bucket.tokens = std::max(bucket.tokens, -BUS_BURST_US);
+}
+
+std::vector<BusStatus> BusScheduler::getStatus()
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    Clock::time_point now = Clock::now();
+    int64_t slot = toSlot(now - mEpoch);
+
+    std::vector<BusStatus> status;
+    for (auto &it : mBuckets) {
+        Bucket &bucket = refill(it.first, now);
+
+        // Slots are only cleared when the adapter sends again, so skip
+        // the ones that fell out of the window while it was idle.
+        int64_t busy = 0;
+        int64_t first = std::max(bucket.busySlot, slot) - BUS_STATS_WINDOW_SEC + 1;
+        for (int64_t s = std::max<int64_t>(0, first); s <= bucket.busySlot; s++)
+            busy += bucket.busy[s % BUS_STATS_WINDOW_SEC];
+
+        BusStatus entry;
+        entry.adapter = it.first;
+        entry.utilization = static_cast<int>(std::min<int64_t>(100, busy / (BUS_STATS_WINDOW_SEC * 10000)));
+        entry.availableMs = std::max<int64_t>(0, bucket.tokens) / 1000;
+        entry.framesSent = bucket.framesSent;
+        entry.deferred = bucket.deferred;
+        entry.deferredTimeMs = bucket.deferredTimeMs;
+        status.push_back(entry);
+    }
+    return status;
+}
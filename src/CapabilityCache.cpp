@@ -0,0 +1,179 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include "CapabilityCache.h"
+#include "Logger.h"
+
+CapabilityCache& CapabilityCache::instance()
+{
+    // Leaked on purpose, handler callbacks may still run during exit
+    static CapabilityCache *cache = new CapabilityCache();
+    return *cache;
+}
+
+void CapabilityCache::configure(const std::string &path)
+{
+    CapabilityCache &cache = instance();
+    std::unique_lock<std::mutex> lock(cache.mMutex);
+    cache.mPath = path;
+    cache.load(path);
+}
+
+// Called with mMutex held
+bool CapabilityCache::load(const std::string &path)
+{
+    FILE *file = fopen(path.c_str(), "r");
+    if (!file) {
+        AppLogInfo() << "No capability cache at " << path;
+        return false;
+    }
+
+    char line[128];
+    size_t count = 0;
+    while (fgets(line, sizeof(line), file)) {
+        unsigned address, opcode, reason;
+        int consumed = 0;
+        if (sscanf(line, "%4x\t%2x\t%2x\t%n", &address, &opcode, &reason, &consumed) != 3 || !consumed)
+            continue;
+        std::string vendor(line + consumed);
+        while (!vendor.empty() && (vendor.back() == '\n' || vendor.back() == '\r'))
+            vendor.pop_back();
+
+        Entry entry{CAPABILITY_ABORTED, static_cast<uint8_t>(reason), std::chrono::steady_clock::time_point::max(), 0};
+        mDevices[DeviceKey(static_cast<uint16_t>(address), vendor)][static_cast<uint8_t>(opcode)] = entry;
+        count++;
+    }
+    fclose(file);
+    AppLogInfo() << "Loaded " << count << " unsupported opcodes from " << path;
+    return true;
+}
+
+bool CapabilityCache::save()
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    if (mPath.empty() || !mDirty)
+        return true;
+
+    std::string tmpPath = mPath + ".tmp";
+    FILE *file = fopen(tmpPath.c_str(), "w");
+    if (!file) {
+        AppLogError() << "Cannot write capability cache " << tmpPath << ": " << strerror(errno);
+        return false;
+    }
+    for (const auto &device : mDevices) {
+        for (const auto &opcode : device.second) {
+            if (opcode.second.failure != CAPABILITY_ABORTED)
+                continue;
+            fprintf(file, "%04x\t%02x\t%02x\t%s\n", device.first.first, opcode.first,
+                    opcode.second.reason, device.first.second.c_str());
+        }
+    }
+    bool ok = fclose(file) == 0 && rename(tmpPath.c_str(), mPath.c_str()) == 0;
+    if (!ok) {
+        AppLogError() << "Cannot save capability cache " << mPath << ": " << strerror(errno);
+        return false;
+    }
+    mDirty = false;
+    return true;
+}
+
+// Called with mMutex held
+void CapabilityCache::record(const DeviceKey &key, uint8_t opcode, const Entry &entry)
+{
+    Entry &current = mDevices[key][opcode];
+    // Only aborts are saved, a changed miss does not need writing
+    if (entry.failure == CAPABILITY_ABORTED || current.failure == CAPABILITY_ABORTED)
+        mDirty = mDirty || current.failure != entry.failure || current.reason != entry.reason;
+    current = entry;
+}
+
+void CapabilityCache::recordAbort(const std::string &vendor, uint16_t address, uint8_t opcode, uint8_t reason)
+{
+    AppLogDebug() << "CapabilityCache::" << __func__ << ":" << __LINE__ << " " << address << " opcode " << (int)opcode
+                  << " reason " << (int)reason;
+    std::unique_lock<std::mutex> lock(mMutex);
+    record(DeviceKey(address, vendor), opcode,
+           Entry{CAPABILITY_ABORTED, reason, std::chrono::steady_clock::time_point::max(), 0});
+}
+
+void CapabilityCache::recordNoReply(const std::string &vendor, uint16_t address, uint8_t opcode)
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    auto now = std::chrono::steady_clock::now();
+    uint8_t misses = 1;
+    auto device = mDevices.find(DeviceKey(address, vendor));
+    if (device != mDevices.end()) {
+        auto it = device->second.find(opcode);
+        // An abort says more than a missing reply
+        if (it != device->second.end() && it->second.failure == CAPABILITY_ABORTED)
+            return;
+        if (it != device->second.end() && now < it->second.until && it->second.misses < UINT8_MAX)
+            misses = it->second.misses + 1;
+    }
+    AppLogDebug() << "CapabilityCache::" << __func__ << ":" << __LINE__ << " " << address << " opcode " << (int)opcode
+                  << " misses " << (int)misses;
+    record(DeviceKey(address, vendor), opcode,
+           Entry{CAPABILITY_NO_REPLY, 0, now + std::chrono::milliseconds(CAPABILITY_NO_REPLY_TTL_MS), misses});
+}
+
+void CapabilityCache::recordSuccess(const std::string &vendor, uint16_t address, uint8_t opcode)
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    auto device = mDevices.find(DeviceKey(address, vendor));
+    if (device == mDevices.end())
+        return;
+    auto it = device->second.find(opcode);
+    if (it == device->second.end())
+        return;
+    mDirty = mDirty || it->second.failure == CAPABILITY_ABORTED;
+    device->second.erase(it);
+    if (device->second.empty())
+        mDevices.erase(device);
+}
+
+bool CapabilityCache::lookup(const std::string &vendor, uint16_t address, uint8_t opcode, Entry &entry)
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    auto device = mDevices.find(DeviceKey(address, vendor));
+    if (device == mDevices.end())
+        return false;
+    auto it = device->second.find(opcode);
+    if (it == device->second.end())
+        return false;
+    if (std::chrono::steady_clock::now() >= it->second.until) {
+        device->second.erase(it);
+        return false;
+    }
+    // A single miss may have been a busy device or a lost reply
+    if (it->second.failure == CAPABILITY_NO_REPLY && it->second.misses < CAPABILITY_NO_REPLY_THRESHOLD)
+        return false;
+    entry = it->second;
+    return true;
+}
+
+void CapabilityCache::expire(uint16_t address)
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    auto it = mDevices.lower_bound(DeviceKey(address, std::string()));
+    while (it != mDevices.end() && it->first.first == address) {
+        mDirty = true;
+        it = mDevices.erase(it);
+    }
+}
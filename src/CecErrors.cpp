@@ -31,7 +31,12 @@ static std::map<CecErrorCode, std::string> cecErrorTextTable = {
     {CEC_ERR_COMMAND_PARAM_MISSING, "Required command parameter is missing"},
     {CEC_ERR_KEY_PARAM_MISSING, "Required parameter key is missing"},
     {CEC_ERR_VALUE_PARAM_MISSING, "Required parameter value is missing"},
-    {CEC_ERR_UNKNOWN_ERROR, "Unknown error"}
+    {CEC_ERR_UNKNOWN_ERROR, "Unknown error"},
+    {CEC_ERR_FRAME_NOT_ACKNOWLEDGED, "Frame was not acknowledged by the destination"},
+    {CEC_ERR_DEST_DEVICE_UNAVAILABLE, "Destination device is not responding"},
+    {CEC_ERR_DEADLINE_EXCEEDED, "Request could not be sent within its timeout"},
+    {CEC_ERR_BUSY, "Too many requests from this client, try again later"},
+    {CEC_ERR_CMD_UNSUPPORTED_BY_DEVICE, "Destination device did not answer this command before, it was not sent"}
 };
 
 const std::string retrieveErrorText(CecErrorCode errorCode) {
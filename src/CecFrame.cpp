@@ -0,0 +1,283 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include <cstdio>
+
+#include "CecFrame.h"
+
+static_assert(findCecOpcode(CEC_OPCODE_STANDBY)->maxOperands == 0, "opcode table lookup is not constexpr");
+static_assert(findCecOpcode(0x01) == nullptr, "opcode table contains a reserved opcode");
+static_assert(cecFrameHeader(0x04, 0x0F) == 0x4F, "frame header encoding");
+
+static int hexDigit(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+struct UserControlKey {
+    const char *name;
+    uint8_t code;
+};
+
+static const UserControlKey userControlKeys[] = {
+    { "select", 0x00 },
+    { "up", 0x01 },
+    { "down", 0x02 },
+    { "left", 0x03 },
+    { "right", 0x04 },
+    { "root-menu", 0x09 },
+    { "setup-menu", 0x0A },
+    { "contents-menu", 0x0B },
+    { "exit", 0x0D },
+    { "number-0", 0x20 },
+    { "number-1", 0x21 },
+    { "number-2", 0x22 },
+    { "number-3", 0x23 },
+    { "number-4", 0x24 },
+    { "number-5", 0x25 },
+    { "number-6", 0x26 },
+    { "number-7", 0x27 },
+    { "number-8", 0x28 },
+    { "number-9", 0x29 },
+    { "channel-up", 0x30 },
+    { "channel-down", 0x31 },
+    { "input-select", 0x34 },
+    { "display-info", 0x35 },
+    { "power", 0x40 },
+    { "volume-up", 0x41 },
+    { "volume-down", 0x42 },
+    { "mute", 0x43 },
+    { "play", 0x44 },
+    { "stop", 0x45 },
+    { "pause", 0x46 },
+    { "record", 0x47 },
+    { "rewind", 0x48 },
+    { "fast-forward", 0x49 },
+    { "eject", 0x4A },
+    { "forward", 0x4B },
+    { "backward", 0x4C },
+    { "power-toggle", 0x6B },
+    { "power-off", 0x6C },
+    { "power-on", 0x6D },
+    { "blue", 0x71 },
+    { "red", 0x72 },
+    { "green", 0x73 },
+    { "yellow", 0x74 }
+};
+
+bool cecUserControlCode(const std::string &key, uint8_t &code)
+{
+    for (auto &entry : userControlKeys) {
+        if (key == entry.name) {
+            code = entry.code;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool parseIncomingFrame(const LineView &line, CecFrame &frame)
+{
+    std::size_t pos = line.find(">>");
+    if (pos == std::string::npos)
+        return false;
+    pos = line.find_first_not_of(" \t", pos + 2);
+    if (pos == std::string::npos)
+        return false;
+
+    uint8_t bytes[CEC_MAX_OPERANDS + 2];
+    std::size_t count = 0;
+    while (count < sizeof(bytes)) {
+        if (pos + 1 >= line.size())
+            return false;
+        int hi = hexDigit(line[pos]);
+        int lo = hexDigit(line[pos + 1]);
+        if (hi < 0 || lo < 0)
+            return false;
+        bytes[count++] = static_cast<uint8_t>((hi << 4) | lo);
+        pos += 2;
+        if (pos >= line.size() || line[pos] != ':')
+            break;
+        pos++;
+    }
+
+    if (!count || line.find_first_not_of(" \t\r\n", pos) != std::string::npos)
+        return false;
+
+    frame = CecFrame();
+    frame.initiator = bytes[0] >> 4;
+    frame.destination = bytes[0] & 0x0F;
+    if (count > 1) {
+        frame.hasOpcode = true;
+        frame.opcode = bytes[1];
+        frame.length = static_cast<uint8_t>(count - 2);
+        for (std::size_t i = 0; i < frame.length; i++)
+            frame.operands[i] = bytes[i + 2];
+    }
+    return true;
+}
+
+bool validateCecFrame(const CecFrame &frame)
+{
+    if (frame.length > CEC_MAX_OPERANDS || (!frame.hasOpcode && frame.length))
+        return false;
+    if (!frame.hasOpcode)
+        return !frame.isBroadcast();
+
+    const CecOpcodeInfo *info = findCecOpcode(frame.opcode);
+    if (!info)
+        return true;
+    if (frame.length < info->minOperands || frame.length > info->maxOperands)
+        return false;
+    return (info->addressing & (frame.isBroadcast() ? CEC_BROADCAST : CEC_DIRECTED)) != 0;
+}
+
+bool encodeCecPayload(const CecFrame &frame, char *buf, size_t size)
+{
+    static const char digits[] = "0123456789abcdef";
+    size_t needed = frame.hasOpcode ? 3 * (frame.length + 1) : 1;
+    if (!size || needed > size)
+        return false;
+
+    size_t pos = 0;
+    if (frame.hasOpcode) {
+        buf[pos++] = digits[frame.opcode >> 4];
+        buf[pos++] = digits[frame.opcode & 0x0F];
+        for (uint8_t i = 0; i < frame.length; i++) {
+            buf[pos++] = ':';
+            buf[pos++] = digits[frame.operands[i] >> 4];
+            buf[pos++] = digits[frame.operands[i] & 0x0F];
+        }
+    }
+    buf[pos] = '\0';
+    return true;
+}
+
+const char* cecLogicalAddressName(uint8_t address)
+{
+    static const char *names[] = {
+        "TV", "Recorder 1", "Recorder 2", "Tuner 1", "Playback 1", "Audio", "Tuner 2", "Tuner 3",
+        "Playback 2", "Recorder 3", "Tuner 4", "Playback 3", "Reserved 1", "Reserved 2", "Free use", "Broadcast"
+    };
+    return names[address & 0x0F];
+}
+
+std::string cecPhysicalAddressString(uint8_t high, uint8_t low)
+{
+    char buf[8];
+    snprintf(buf, sizeof(buf), "%x.%x.%x.%x", high >> 4, high & 0x0F, low >> 4, low & 0x0F);
+    return buf;
+}
+
+std::string cecPhysicalAddressString(uint16_t address)
+{
+    return cecPhysicalAddressString(static_cast<uint8_t>(address >> 8), static_cast<uint8_t>(address & 0xFF));
+}
+
+bool parseCecPhysicalAddress(const std::string &text, uint16_t &address)
+{
+    if (text.size() != 7)
+        return false;
+    uint16_t value = 0;
+    bool ended = false;
+    for (size_t i = 0; i < 4; i++) {
+        if (i && text[2 * i - 1] != '.')
+            return false;
+        int nibble = hexDigit(text[2 * i]);
+        if (nibble < 0 || (ended && nibble))
+            return false;
+        ended = !nibble;
+        value = static_cast<uint16_t>((value << 4) | nibble);
+    }
+    address = value;
+    return true;
+}
+
+std::string cecPowerStatusString(uint8_t status)
+{
+    switch (status) {
+        case 0x00: return "on";
+        case 0x01: return "standby";
+        case 0x02: return "in transition from standby to on";
+        case 0x03: return "in transition from on to standby";
+        default: return "unknown";
+    }
+}
+
+std::string cecVersionString(uint8_t version)
+{
+    switch (version) {
+        case 0x04: return "1.3a";
+        case 0x05: return "1.4";
+        case 0x06: return "2.0";
+        default: return "unknown";
+    }
+}
+
+std::string cecVendorString(uint32_t vendorId)
+{
+    switch (vendorId) {
+        case 0x00E091: return "LG";
+        case 0x0000F0: return "Samsung";
+        case 0x080046: return "Sony";
+        case 0x00903E: return "Philips";
+        case 0x000039: return "Toshiba";
+        case 0x008045: return "Panasonic";
+        case 0x00A0DE: return "Yamaha";
+        case 0x0005CD: return "Denon";
+        case 0x0009B0: return "Onkyo";
+        default: {
+            char buf[16];
+            snprintf(buf, sizeof(buf), "%06x", vendorId);
+            return buf;
+        }
+    }
+}
+
+const char* cecAbortReasonString(uint8_t reason)
+{
+    switch (reason) {
+        case 0x00: return "unrecognized opcode";
+        case 0x01: return "not in correct mode to respond";
+        case 0x02: return "cannot provide source";
+        case 0x03: return "invalid operand";
+        case 0x04: return "refused";
+        case 0x05: return "unable to determine";
+        default: return "unknown";
+    }
+}
+
+bool cecExpectedReply(uint8_t opcode, uint8_t &reply)
+{
+    switch (opcode) {
+        case CEC_OPCODE_GIVE_OSD_NAME: reply = CEC_OPCODE_SET_OSD_NAME; return true;
+        case CEC_OPCODE_GIVE_AUDIO_STATUS: reply = CEC_OPCODE_REPORT_AUDIO_STATUS; return true;
+        case CEC_OPCODE_GIVE_SYSTEM_AUDIO_MODE_STATUS: reply = CEC_OPCODE_SYSTEM_AUDIO_MODE_STATUS; return true;
+        case CEC_OPCODE_GIVE_PHYSICAL_ADDRESS: reply = CEC_OPCODE_REPORT_PHYSICAL_ADDRESS; return true;
+        case CEC_OPCODE_GIVE_DEVICE_VENDOR_ID: reply = CEC_OPCODE_DEVICE_VENDOR_ID; return true;
+        case CEC_OPCODE_MENU_REQUEST: reply = CEC_OPCODE_MENU_STATUS; return true;
+        case CEC_OPCODE_GIVE_DEVICE_POWER_STATUS: reply = CEC_OPCODE_REPORT_POWER_STATUS; return true;
+        case CEC_OPCODE_GET_MENU_LANGUAGE: reply = CEC_OPCODE_SET_MENU_LANGUAGE; return true;
+        case CEC_OPCODE_GET_CEC_VERSION: reply = CEC_OPCODE_CEC_VERSION; return true;
+        default: return false;
+    }
+}
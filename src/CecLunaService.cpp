@@ -20,12 +20,61 @@
 #include "Ls2Utils.h"
 #include "CecController.h"
 #include "CecLunaService.h"
+#include "ObjectPool.h"
 
 const std::string SERVICE_NAME = "com.webos.service.cec";
+// Replies sent per main loop iteration
+const int COMPLETION_BATCH = 16;
+
+static CecErrorCode toCecErrorCode(HandlerErrorCode error) {
+    switch (error) {
+        case HANDLER_ERROR_INVALID_PARAMTERS:
+            return CEC_INVALID_INPUT_PARAM;
+        case HANDLER_ERROR_INVALID_COMMAND:
+            return CEC_INVALID_INPUT_COMMAND;
+        case HANDLER_ERROR_INVALID_ADAPTER:
+            return CEC_ERR_NO_CEC_ADAPTER_FOUND;
+        case HANDLER_ERROR_INVALID_DESTINATION:
+            return CEC_DEST_DEVICE_NOT_FOUND;
+        case HANDLER_ERROR_DESTINATION_UNAVAILABLE:
+            return CEC_ERR_DEST_DEVICE_UNAVAILABLE;
+        default:
+            return CEC_ERR_UNKNOWN_ERROR;
+    }
+}
+
+// The "command" object of a sendCommand request
+static CecCommand parseCecCommand(pbnjson::JValue cecCommandObj) {
+    CecCommand ceccommand;
+    ceccommand.name = cecCommandObj["name"].asString();
+    if (cecCommandObj.hasKey("args")) {
+        auto argsObj = cecCommandObj["args"];
+        ssize_t argsSize = argsObj.arraySize();
+
+        for (auto i = 0; i < argsSize; ++i) {
+            auto argObj = argsObj[i];
+            CecCommandArg commandArg;
+            commandArg.arg = argObj["arg"].asString();
+            if (argObj.hasKey("value")) {
+                commandArg.value = argObj["value"].asString();
+            }
+            ceccommand.args.push_back(commandArg);
+        }
+    }
+    return ceccommand;
+}
 
 CecLunaService::CecLunaService() :
-        LS::Handle(SERVICE_NAME.c_str()) {
+        LS::Handle(SERVICE_NAME.c_str()), m_completionsScheduled(false) {
     registerMethods();
+    m_eventSubscription.setServiceHandle(this);
+    LSError lserror;
+    LSErrorInit(&lserror);
+    if (!LSCallCancelNotificationAdd(get(), &CecLunaService::cancelCb, this, &lserror)) {
+        AppLogError() << "Failed to register cancel notification: " << lserror.message << "\n";
+        LSErrorFree(&lserror);
+    }
+    CecController::getInstance()->AddEventListener(std::bind(&CecLunaService::postEvent, this, std::placeholders::_1, std::placeholders::_2));
     AppLogInfo()<<" CecLunaService:: call async method"<<"\n";
     CecController::getInstance()->m_InitFut = std::async(std::launch::async, []() {
         return CecController::getInstance()->initialize();
@@ -33,7 +82,10 @@ CecLunaService::CecLunaService() :
 }
 
 CecLunaService::~CecLunaService() {
-
+    LSError lserror;
+    LSErrorInit(&lserror);
+    if (!LSCallCancelNotificationRemove(get(), &CecLunaService::cancelCb, this, &lserror))
+        LSErrorFree(&lserror);
 }
 
 void CecLunaService::registerMethods() {
@@ -44,12 +96,80 @@ void CecLunaService::registerMethods() {
     LS_CATEGORY_CLASS_METHOD(CecLunaService, sendCommand)
     LS_CATEGORY_CLASS_METHOD(CecLunaService, getConfig)
     LS_CATEGORY_CLASS_METHOD(CecLunaService, setConfig)
+    LS_CATEGORY_CLASS_METHOD(CecLunaService, getEvents)
+    LS_CATEGORY_CLASS_METHOD(CecLunaService, sendKey)
+    LS_CATEGORY_CLASS_METHOD(CecLunaService, sendFrame)
+    LS_CATEGORY_CLASS_METHOD(CecLunaService, getBusStatus)
+    LS_CATEGORY_CLASS_METHOD(CecLunaService, getTopology)
     LS_CREATE_CATEGORY_END
 
     registerCategory("/", LS_CATEGORY_TABLE_NAME(base), NULL, NULL);
     setCategoryData("/", this);
 }
 
+std::string CecLunaService::getCallerId(LSMessage *message) {
+    const char *caller = LSMessageGetApplicationID(message);
+    if (!caller || !*caller)
+        caller = LSMessageGetSenderServiceName(message);
+    if (!caller || !*caller)
+        caller = LSMessageGetSender(message);
+    return caller ? caller : "";
+}
+
+// Control requests skip admission, the user is waiting on them
+bool CecLunaService::submitRequest(LS::Message &request, pbnjson::JValue &requestObj, RequestHandler handler,
+                                   bool control) {
+    std::string caller = getCallerId(request.get());
+    if (!control && !m_scheduler.admit(caller)) {
+        LSUtils::respondWithError(request, CEC_ERR_BUSY);
+        return false;
+    }
+
+    LSMessage *requestMessage = request.get();
+    ClientRequest client;
+    client.message = requestMessage;
+    client.caller = caller;
+    const char *token = LSMessageGetUniqueToken(requestMessage);
+    client.token = token ? token : "";
+    ClientHandle clientId = m_clients.insert(std::move(client));
+    if (clientId == INVALID_CLIENT_HANDLE) {
+        LSUtils::respondWithError(request, CEC_ERR_BUSY);
+        return false;
+    }
+    LSMessageRef(requestMessage);
+    m_scheduler.submit(caller, clientId, [this, handler, requestObj, clientId]() mutable {
+        (this->*handler)(requestObj, clientId);
+    }, control);
+    return true;
+}
+
+void CecLunaService::trackCommand(ClientHandle clientId, std::shared_ptr<Command> command) {
+    m_clients.setCommand(clientId, std::move(command));
+}
+
+bool CecLunaService::cancelCb(LSHandle *sh, const char *uniqueToken, void *ctx) {
+    CecLunaService *pThis = static_cast<CecLunaService*>(ctx);
+    if (!pThis || !uniqueToken)
+        return true;
+
+    ClientRequest client;
+    ClientHandle clientId = pThis->m_clients.findToken(uniqueToken);
+    if (!pThis->m_clients.release(clientId, client))
+        return true;
+
+    AppLogInfo() << "Request cancelled by " << client.caller << "\n";
+    // Not released yet it never reaches the controller. Otherwise the
+    // command is marked, the queue drops it if unsent and the handler
+    // drops its reply.
+    if (!pThis->m_scheduler.cancel(client.caller, clientId)) {
+        if (client.command)
+            client.command->cancel();
+        pThis->m_scheduler.complete(client.caller);
+    }
+    LSMessageUnref(client.message);
+    return true;
+}
+
 bool CecLunaService::listAdapters(LSMessage &message) {
 
     AppLogDebug() <<__func__<<"\n";
@@ -67,20 +187,19 @@ bool CecLunaService::listAdapters(LSMessage &message) {
         return true;
     } else {
         //Create Command and send to CEC Controller
-        LSMessage *requestMessage = request.get();
-        LSMessageRef(requestMessage);
-        m_clients[++m_clientId] = requestMessage;
-        handleListAdapters(requestObj);
+        submitRequest(request, requestObj, &CecLunaService::handleListAdapters);
         return true;
     }
 }
 
-void CecLunaService::handleListAdapters(pbnjson::JValue &requestObj) {
+void CecLunaService::handleListAdapters(pbnjson::JValue &requestObj, ClientHandle clientId) {
 
     AppLogDebug() <<__func__<<"\n";
-    std::shared_ptr<Command> command = std::make_shared < Command
-            > (CommandType::LIST_ADAPTERS, std::bind(&CecLunaService::callback, this, m_clientId,
-                    CommandType::LIST_ADAPTERS, std::placeholders::_1));
+    std::shared_ptr<Command> command = makePooled<Command>(CommandType::LIST_ADAPTERS,
+            [this, clientId](std::shared_ptr<CommandResData> respData) {
+                callback(this, clientId, CommandType::LIST_ADAPTERS, std::move(respData));
+            });
+    trackCommand(clientId, command);
     //Send command to CEC Controller
     CecController::getInstance()->HandleCommand(std::move(command));
 }
@@ -90,7 +209,7 @@ bool CecLunaService::scan(LSMessage &message) {
     AppLogDebug() <<__func__<<"\n";
     LS::Message request(&message);
     pbnjson::JValue requestObj;
-    const std::string schema = SCHEMA_1(PROP(adapter, string));
+    const std::string schema = STRICT_SCHEMA(PROPS_2(PROP(adapter, string), PROP(incremental, boolean)));
 
     int parseError = 0;
     if (!LSUtils::parsePayload(request.getPayload(), requestObj, schema, &parseError)) {
@@ -103,27 +222,29 @@ bool CecLunaService::scan(LSMessage &message) {
     } else {
 
         //Create Command and send to CEC Controller
-        LSMessage *requestMessage = request.get();
-        LSMessageRef(requestMessage);
-        m_clients[++m_clientId] = requestMessage;
-        handleScan(requestObj);
+        submitRequest(request, requestObj, &CecLunaService::handleScan);
         return true;
     }
 }
 
-void CecLunaService::handleScan(pbnjson::JValue &requestObj) {
+void CecLunaService::handleScan(pbnjson::JValue &requestObj, ClientHandle clientId) {
 
     AppLogDebug() <<__func__<<"\n";
-    std::shared_ptr<Command> command = std::make_shared < Command
-            > (CommandType::SCAN, std::bind(&CecLunaService::callback, this, m_clientId, CommandType::SCAN,
-                    std::placeholders::_1));
+    std::shared_ptr<Command> command = makePooled<Command>(CommandType::SCAN,
+            [this, clientId](std::shared_ptr<CommandResData> respData) {
+                callback(this, clientId, CommandType::SCAN, std::move(respData));
+            });
 
-    std::shared_ptr<ScanReqData> data = std::make_shared<ScanReqData>();
+    std::shared_ptr<ScanReqData> data = makePooled<ScanReqData>();
 
     if (requestObj.hasKey("adapter")) {
         data->adapter = requestObj["adapter"].asString();
     }
+    if (requestObj.hasKey("incremental")) {
+        data->incremental = requestObj["incremental"].asBool();
+    }
     command->setData(data);
+    trackCommand(clientId, command);
     //Send command to CEC Controller
     CecController::getInstance()->HandleCommand(std::move(command));
 }
@@ -135,9 +256,10 @@ bool CecLunaService::sendCommand(LSMessage &message) {
     pbnjson::JValue requestObj;
     const std::string schema =
             STRICT_SCHEMA(
-                    PROPS_4(PROP(adapter, string),
+                    PROPS_5(PROP(adapter, string),
                             PROP(destAddress, string),
                             PROP(timeout, integer),
+                            PROP(discover, boolean),
                             OBJECT(command, OBJSCHEMA_2_STRICT(
                                     PROP(name, string),
                                     OBJARRAY(args, OBJSCHEMA_2_STRICT(
@@ -157,22 +279,21 @@ bool CecLunaService::sendCommand(LSMessage &message) {
         return true;
     } else {
         //Create Command and send to CEC Controller
-        LSMessage *requestMessage = request.get();
-        LSMessageRef(requestMessage);
-        m_clients[++m_clientId] = requestMessage;
-        handleSendCommand(requestObj);
+        submitRequest(request, requestObj, &CecLunaService::handleSendCommand,
+                      isControlCommand(parseCecCommand(requestObj["command"])));
         return true;
     }
 }
 
-void CecLunaService::handleSendCommand(pbnjson::JValue &requestObj) {
+void CecLunaService::handleSendCommand(pbnjson::JValue &requestObj, ClientHandle clientId) {
 
     AppLogDebug() <<__func__<<"\n";
-    std::shared_ptr<Command> command = std::make_shared < Command
-            > (CommandType::SEND_COMMAND, std::bind(&CecLunaService::callback, this, m_clientId,
-                    CommandType::SEND_COMMAND, std::placeholders::_1));
+    std::shared_ptr<Command> command = makePooled<Command>(CommandType::SEND_COMMAND,
+            [this, clientId](std::shared_ptr<CommandResData> respData) {
+                callback(this, clientId, CommandType::SEND_COMMAND, std::move(respData));
+            });
 
-    std::shared_ptr<SendCommandReqData> data = std::make_shared<SendCommandReqData>();
+    std::shared_ptr<SendCommandReqData> data = makePooled<SendCommandReqData>();
     if (requestObj.hasKey("adapter")) {
         data->adapter = requestObj["adapter"].asString();
     }
@@ -181,31 +302,257 @@ void CecLunaService::handleSendCommand(pbnjson::JValue &requestObj) {
     if (requestObj.hasKey("timeout")) {
         data->timeout = requestObj["timeout"].asNumber<int32_t>();
     }
+    if (requestObj.hasKey("discover")) {
+        data->discover = requestObj["discover"].asBool();
+    }
 
-    CecCommand ceccommand;
-    auto cecCommandObj = requestObj["command"];
-    ceccommand.name = cecCommandObj["name"].asString();
-    if (cecCommandObj.hasKey("args")) {
-        auto argsObj = cecCommandObj["args"];
-        ssize_t argsSize = argsObj.arraySize();
+    data->command = parseCecCommand(requestObj["command"]);
 
-        for (auto i = 0; i < argsSize; ++i) {
-            auto argObj = argsObj[i];
-            CecCommandArg commandArg;
-            commandArg.arg = argObj["arg"].asString();
-            if (argObj.hasKey("value")) {
-                commandArg.value = argObj["value"].asString();
-            }
-            ceccommand.args.push_back(commandArg);
-        }
+    command->setData(data);
+    trackCommand(clientId, command);
+    //Send command to CEC Controller
+    CecController::getInstance()->HandleCommand(std::move(command));
+}
+
+bool CecLunaService::sendKey(LSMessage &message) {
+
+    LS::Message request(&message);
+    pbnjson::JValue requestObj;
+    // Compiled once, key presses are latency sensitive.
+    static const pbnjson::JSchemaFragment schema(
+            STRICT_SCHEMA(
+                    PROPS_6(PROP(adapter, string),
+                            PROP(destAddress, string),
+                            PROP(key, string),
+                            PROP_WITH_VAL_3(action, string, "press", "release", "hold"),
+                            PROP(repeatInterval, integer),
+                            PROP(holdTimeout, integer))
+                    REQUIRED_3(destAddress, key, action)));
+
+    int parseError = 0;
+    if (!LSUtils::parsePayload(request.getPayload(), requestObj, schema, &parseError)) {
+        AppLogError() << "Parser error: CecLunaService::sendKey code: " << parseError << "\n";
+        if (JSON_PARSE_SCHEMA_ERROR != parseError)
+            LSUtils::respondWithError(request, CEC_ERR_BAD_JSON);
+        else
+            LSUtils::respondWithError(request, CEC_ERR_SCHEMA_VALIDATION_FAILED);
+        return true;
+    }
+
+    // Keys go straight to the key lane, which merges repeats itself, and
+    // are not held back by the request quota
+    SendKeyReqData keyData;
+    if (requestObj.hasKey("adapter")) {
+        keyData.adapter = requestObj["adapter"].asString();
+    }
+    keyData.destAddress = requestObj["destAddress"].asString();
+    keyData.key = requestObj["key"].asString();
+    std::string action = requestObj["action"].asString();
+    keyData.pressed = action != "release";
+    keyData.hold = action == "hold";
+    if (requestObj.hasKey("repeatInterval")) {
+        keyData.repeatInterval = requestObj["repeatInterval"].asNumber<int32_t>();
+    }
+    if (requestObj.hasKey("holdTimeout")) {
+        keyData.holdTimeout = requestObj["holdTimeout"].asNumber<int32_t>();
+    }
+
+    HandlerErrorCode error = CecController::getInstance()->SendKey(keyData);
+    if (error != HANDLER_ERROR_OK) {
+        LSUtils::respondWithError(request, toCecErrorCode(error));
+        return true;
+    }
+
+    pbnjson::JValue responseObj = pbnjson::Object();
+    responseObj.put("returnValue", true);
+    LSUtils::postToClient(request, responseObj);
+    return true;
+}
+
+static bool isFrameByte(const pbnjson::JValue &value, int32_t max) {
+    int32_t byte = value.asNumber<int32_t>();
+    return byte >= 0 && byte <= max;
+}
+
+bool CecLunaService::sendFrame(LSMessage &message) {
+
+    AppLogDebug() <<__func__<<"\n";
+    LS::Message request(&message);
+    pbnjson::JValue requestObj;
+    const std::string schema =
+            STRICT_SCHEMA(
+                    PROPS_5(PROP(adapter, string),
+                            PROP(destination, integer),
+                            PROP(opcode, integer),
+                            ARRAY(operands, integer),
+                            PROP(timeout, integer))
+                    REQUIRED_1(destination));
+
+    int parseError = 0;
+    if (!LSUtils::parsePayload(request.getPayload(), requestObj, schema, &parseError)) {
+        AppLogError() << "Parser error: CecLunaService::sendFrame code: " << parseError << "\n";
+        if (JSON_PARSE_SCHEMA_ERROR != parseError)
+            LSUtils::respondWithError(request, CEC_ERR_BAD_JSON);
+        else
+            LSUtils::respondWithError(request, CEC_ERR_SCHEMA_VALIDATION_FAILED);
+        return true;
+    }
+
+    // Byte ranges are checked here, the frame itself only holds bytes.
+    bool valid = isFrameByte(requestObj["destination"], CEC_BROADCAST_ADDRESS);
+    if (requestObj.hasKey("opcode"))
+        valid = valid && isFrameByte(requestObj["opcode"], 0xFF);
+    if (requestObj.hasKey("operands")) {
+        auto operandsObj = requestObj["operands"];
+        valid = valid && requestObj.hasKey("opcode") && operandsObj.arraySize() <= CEC_MAX_OPERANDS;
+        for (ssize_t i = 0; valid && i < operandsObj.arraySize(); ++i)
+            valid = isFrameByte(operandsObj[i], 0xFF);
+    }
+    if (!valid) {
+        LSUtils::respondWithError(request, CEC_INVALID_INPUT_PARAM);
+        return true;
+    }
+
+    submitRequest(request, requestObj, &CecLunaService::handleSendFrame);
+    return true;
+}
+
+void CecLunaService::handleSendFrame(pbnjson::JValue &requestObj, ClientHandle clientId) {
+
+    AppLogDebug() <<__func__<<"\n";
+    std::shared_ptr<Command> command = makePooled<Command>(CommandType::SEND_FRAME,
+            [this, clientId](std::shared_ptr<CommandResData> respData) {
+                callback(this, clientId, CommandType::SEND_FRAME, std::move(respData));
+            });
+
+    std::shared_ptr<SendFrameReqData> data = makePooled<SendFrameReqData>();
+    if (requestObj.hasKey("adapter")) {
+        data->adapter = requestObj["adapter"].asString();
+    }
+    if (requestObj.hasKey("timeout")) {
+        data->timeout = requestObj["timeout"].asNumber<int32_t>();
+    }
+
+    // Frames from this service always originate from the TV.
+    data->frame.initiator = 0;
+    data->frame.destination = static_cast<uint8_t>(requestObj["destination"].asNumber<int32_t>());
+    if (requestObj.hasKey("opcode")) {
+        data->frame.hasOpcode = true;
+        data->frame.opcode = static_cast<uint8_t>(requestObj["opcode"].asNumber<int32_t>());
+    }
+    if (requestObj.hasKey("operands")) {
+        auto operandsObj = requestObj["operands"];
+        data->frame.length = static_cast<uint8_t>(operandsObj.arraySize());
+        for (uint8_t i = 0; i < data->frame.length; ++i)
+            data->frame.operands[i] = static_cast<uint8_t>(operandsObj[i].asNumber<int32_t>());
     }
-    data->command = std::move(ceccommand);
 
     command->setData(data);
+    trackCommand(clientId, command);
     //Send command to CEC Controller
     CecController::getInstance()->HandleCommand(std::move(command));
 }
 
+bool CecLunaService::getBusStatus(LSMessage &message) {
+
+    AppLogDebug() <<__func__<<"\n";
+    LS::Message request(&message);
+    pbnjson::JValue requestObj;
+    const std::string schema = SCHEMA_EMPTY;
+
+    int parseError = 0;
+    if (!LSUtils::parsePayload(request.getPayload(), requestObj, schema, &parseError)) {
+        AppLogError() << "Parser error: CecLunaService::getBusStatus code: " << parseError << "\n";
+        if (JSON_PARSE_SCHEMA_ERROR != parseError)
+            LSUtils::respondWithError(request, CEC_ERR_BAD_JSON);
+        else
+            LSUtils::respondWithError(request, CEC_ERR_SCHEMA_VALIDATION_FAILED);
+        return true;
+    }
+
+    std::vector<BusStatus> status;
+    HandlerErrorCode error = CecController::getInstance()->GetBusStatus(status);
+    if (error != HANDLER_ERROR_OK) {
+        LSUtils::respondWithError(request, toCecErrorCode(error));
+        return true;
+    }
+
+    pbnjson::JValue adaptersArray = pbnjson::Array();
+    for (auto const &bus : status) {
+        pbnjson::JValue adapter = pbnjson::Object();
+        adapter.put("adapter", bus.adapter);
+        adapter.put("utilization", bus.utilization);
+        adapter.put("availableMs", (int64_t) bus.availableMs);
+        adapter.put("framesSent", (int64_t) bus.framesSent);
+        adapter.put("deferred", (int64_t) bus.deferred);
+        adapter.put("deferredTimeMs", (int64_t) bus.deferredTimeMs);
+        adaptersArray.append(adapter);
+    }
+
+    pbnjson::JValue responseObj = pbnjson::Object();
+    responseObj.put("returnValue", true);
+    responseObj.put("busStatus", adaptersArray);
+    LSUtils::postToClient(request, responseObj);
+    return true;
+}
+
+static pbnjson::JValue topologyNode(const CecTopology &topology, const CecTopology::Node &node) {
+    pbnjson::JValue nodeObj = pbnjson::Object();
+    nodeObj.put("physicalAddress", cecPhysicalAddressString(node.address));
+    if (node.logicalAddress >= 0) {
+        nodeObj.put("logicalAddress", (int32_t) node.logicalAddress);
+        nodeObj.put("type", cecLogicalAddressName(static_cast<uint8_t>(node.logicalAddress)));
+    }
+
+    if (node.firstChild == CecTopology::NO_NODE)
+        return nodeObj;
+    pbnjson::JValue inputsArray = pbnjson::Array();
+    for (uint8_t child = node.firstChild; child != CecTopology::NO_NODE; child = topology.node(child).nextSibling) {
+        pbnjson::JValue childObj = topologyNode(topology, topology.node(child));
+        childObj.put("input", (int32_t) CecTopology::inputOf(topology.node(child).address));
+        inputsArray.append(childObj);
+    }
+    nodeObj.put("inputs", inputsArray);
+    return nodeObj;
+}
+
+bool CecLunaService::getTopology(LSMessage &message) {
+
+    AppLogDebug() <<__func__<<"\n";
+    LS::Message request(&message);
+    pbnjson::JValue requestObj;
+    const std::string schema = STRICT_SCHEMA(PROPS_1(PROP(adapter, string)));
+
+    int parseError = 0;
+    if (!LSUtils::parsePayload(request.getPayload(), requestObj, schema, &parseError)) {
+        AppLogError() << "Parser error: CecLunaService::getTopology code: " << parseError << "\n";
+        if (JSON_PARSE_SCHEMA_ERROR != parseError)
+            LSUtils::respondWithError(request, CEC_ERR_BAD_JSON);
+        else
+            LSUtils::respondWithError(request, CEC_ERR_SCHEMA_VALIDATION_FAILED);
+        return true;
+    }
+
+    std::string adapter = DEFAULT_CEC_ADAPTER;
+    if (requestObj.hasKey("adapter")) {
+        adapter = requestObj["adapter"].asString();
+    }
+
+    CecTopology topology;
+    HandlerErrorCode error = CecController::getInstance()->GetTopology(adapter, topology);
+    if (error != HANDLER_ERROR_OK) {
+        LSUtils::respondWithError(request, toCecErrorCode(error));
+        return true;
+    }
+
+    pbnjson::JValue responseObj = pbnjson::Object();
+    responseObj.put("returnValue", true);
+    responseObj.put("adapter", adapter);
+    responseObj.put("topology", topologyNode(topology, topology.root()));
+    LSUtils::postToClient(request, responseObj);
+    return true;
+}
+
 bool CecLunaService::getConfig(LSMessage &message) {
 
     AppLogDebug() <<__func__<<"\n";
@@ -222,27 +569,26 @@ bool CecLunaService::getConfig(LSMessage &message) {
             LSUtils::respondWithError(request, CEC_ERR_SCHEMA_VALIDATION_FAILED);
         return true;
     } else {
-        LSMessage *requestMessage = request.get();
-        LSMessageRef(requestMessage);
-        m_clients[++m_clientId] = requestMessage;
-        handleGetConfig(requestObj);
+        submitRequest(request, requestObj, &CecLunaService::handleGetConfig);
         return true;
     }
 }
 
-void CecLunaService::handleGetConfig(pbnjson::JValue &requestObj) {
+void CecLunaService::handleGetConfig(pbnjson::JValue &requestObj, ClientHandle clientId) {
 
     AppLogDebug() <<__func__<<"\n";
-    std::shared_ptr<Command> command = std::make_shared < Command
-            > (CommandType::GET_CONFIG, std::bind(&CecLunaService::callback, this, m_clientId, CommandType::GET_CONFIG,
-                    std::placeholders::_1));
+    std::shared_ptr<Command> command = makePooled<Command>(CommandType::GET_CONFIG,
+            [this, clientId](std::shared_ptr<CommandResData> respData) {
+                callback(this, clientId, CommandType::GET_CONFIG, std::move(respData));
+            });
 
-    std::shared_ptr<GetConfigReqData> data = std::make_shared<GetConfigReqData>();
+    std::shared_ptr<GetConfigReqData> data = makePooled<GetConfigReqData>();
     data->key = requestObj["key"].asString();
     if (requestObj.hasKey("adapter")) {
         data->adapter = requestObj["adapter"].asString();
     }
     command->setData(data);
+    trackCommand(clientId, command);
     //Send command to CEC Controller
     CecController::getInstance()->HandleCommand(std::move(command));
 }
@@ -264,22 +610,20 @@ bool CecLunaService::setConfig(LSMessage &message) {
             LSUtils::respondWithError(request, CEC_ERR_SCHEMA_VALIDATION_FAILED);
         return true;
     } else {
-        LSMessage *requestMessage = request.get();
-        LSMessageRef(requestMessage);
-        m_clients[++m_clientId] = requestMessage;
-        handleSetConfig(requestObj);
+        submitRequest(request, requestObj, &CecLunaService::handleSetConfig);
         return true;
     }
 }
 
-void CecLunaService::handleSetConfig(pbnjson::JValue &requestObj) {
+void CecLunaService::handleSetConfig(pbnjson::JValue &requestObj, ClientHandle clientId) {
 
     AppLogDebug() <<__func__<<"\n";
-    std::shared_ptr<Command> command = std::make_shared < Command
-            > (CommandType::SET_CONFIG, std::bind(&CecLunaService::callback, this, m_clientId, CommandType::SET_CONFIG,
-                    std::placeholders::_1));
+    std::shared_ptr<Command> command = makePooled<Command>(CommandType::SET_CONFIG,
+            [this, clientId](std::shared_ptr<CommandResData> respData) {
+                callback(this, clientId, CommandType::SET_CONFIG, std::move(respData));
+            });
 
-    std::shared_ptr<SetConfigReqData> data = std::make_shared<SetConfigReqData>();
+    std::shared_ptr<SetConfigReqData> data = makePooled<SetConfigReqData>();
 
     data->key = requestObj["key"].asString();
     data->value = requestObj["value"].asString();
@@ -287,11 +631,63 @@ void CecLunaService::handleSetConfig(pbnjson::JValue &requestObj) {
         data->adapter = requestObj["adapter"].asString();
     }
     command->setData(data);
+    trackCommand(clientId, command);
     //Send command to CEC Controller
     CecController::getInstance()->HandleCommand(std::move(command));
 }
 
-void CecLunaService::callback(void *ctx, uint16_t clientId, enum CommandType type,
+bool CecLunaService::getEvents(LSMessage &message) {
+
+    AppLogDebug() <<__func__<<"\n";
+    LS::Message request(&message);
+    pbnjson::JValue requestObj;
+    const std::string schema = STRICT_SCHEMA(PROPS_1(PROP(subscribe, boolean)) REQUIRED_1(subscribe));
+
+    int parseError = 0;
+    if (!LSUtils::parsePayload(request.getPayload(), requestObj, schema, &parseError)) {
+        AppLogError() << "Parser error: CecLunaService::getEvents code: " << parseError << "\n";
+        if (JSON_PARSE_SCHEMA_ERROR != parseError)
+            LSUtils::respondWithError(request, CEC_ERR_BAD_JSON, true);
+        else
+            LSUtils::respondWithError(request, CEC_ERR_SCHEMA_VALIDATION_FAILED, true);
+        return true;
+    }
+
+    if (!request.isSubscription()) {
+        LSUtils::respondWithError(request, CEC_INVALID_INPUT_PARAM, true);
+        return true;
+    }
+
+    m_eventSubscription.subscribe(request);
+
+    pbnjson::JValue responseObj = pbnjson::Object();
+    responseObj.put("returnValue", true);
+    responseObj.put("subscribed", true);
+    LSUtils::postToClient(request, responseObj);
+    return true;
+}
+
+void CecLunaService::postEvent(const std::string &adapter, const CecFrame &frame) {
+
+    AppLogDebug() <<__func__<<"\n";
+    pbnjson::JValue operandsArray = pbnjson::Array();
+    for (uint8_t i = 0; i < frame.length; i++) {
+        operandsArray.append((int) frame.operands[i]);
+    }
+
+    pbnjson::JValue eventObj = pbnjson::Object();
+    eventObj.put("returnValue", true);
+    eventObj.put("subscribed", true);
+    eventObj.put("adapter", adapter);
+    eventObj.put("event", cecOpcodeName(frame.opcode));
+    eventObj.put("initiator", (int) frame.initiator);
+    eventObj.put("destination", (int) frame.destination);
+    eventObj.put("opcode", (int) frame.opcode);
+    eventObj.put("operands", operandsArray);
+    LSUtils::postToSubscriptionPoint(&m_eventSubscription, eventObj);
+}
+
+void CecLunaService::callback(void *ctx, ClientHandle clientId, enum CommandType type,
         std::shared_ptr<CommandResData> respData) {
 
     AppLogDebug() <<__func__<<"\n";
@@ -300,24 +696,74 @@ void CecLunaService::callback(void *ctx, uint16_t clientId, enum CommandType typ
     if (!pThis)
         return;
 
-    if (pThis->m_clients.find(clientId) != pThis->m_clients.end()) {
-        LSMessage *requestMessage = pThis->m_clients[clientId];
-        LS::Message request(requestMessage);
-        if (respData->returnValue) {
-            //get response object based on command type
-            pbnjson::JValue responseObj = pbnjson::Object();
-            responseObj.put("returnValue", true);
-            pThis->parseResponseObject(responseObj, type, std::move(respData));
-            LSUtils::postToClient(request, responseObj);
+    // Runs on the message queue thread, the reply is built and sent from
+    // the main loop so Luna is only used from one thread.
+    Completion completion;
+    completion.clientId = clientId;
+    completion.type = type;
+    completion.respData = std::move(respData);
+    if (!pThis->m_completions.tryPush(completion)) {
+        // Replies to cancelled calls can still be queued while their slots
+        // take new calls, so the queue may fill. The reply is never dropped.
+        AppLogWarningEvery(1000) <<__func__<<": Completion queue full, replying on its own\n";
+        g_idle_add(&CecLunaService::completeLateCb, new LateCompletion{pThis, std::move(completion)});
+        return;
+    }
+    if (!pThis->m_completionsScheduled.exchange(true))
+        g_idle_add(&CecLunaService::drainCompletions, pThis);
+}
+
+gboolean CecLunaService::drainCompletions(gpointer data) {
+    CecLunaService *pThis = static_cast<CecLunaService*>(data);
+    Completion completion;
+
+    for (int i = 0; i < COMPLETION_BATCH; i++) {
+        if (!pThis->m_completions.pop(completion)) {
+            pThis->m_completionsScheduled = false;
+            // A reply pushed before the flag was cleared did not schedule
+            // a drain, pick it up here.
+            if (!pThis->m_completions.pop(completion))
+                return G_SOURCE_REMOVE;
+            bool scheduled = pThis->m_completionsScheduled.exchange(true);
+            pThis->completeRequest(completion);
+            if (scheduled)
+                return G_SOURCE_REMOVE;
+            continue;
+        }
+        pThis->completeRequest(completion);
+    }
+    // Let other sources run before the next batch
+    return G_SOURCE_CONTINUE;
+}
+
+gboolean CecLunaService::completeLateCb(gpointer data) {
+    std::unique_ptr<LateCompletion> late(static_cast<LateCompletion*>(data));
+    late->service->completeRequest(late->completion);
+    return G_SOURCE_REMOVE;
+}
+
+void CecLunaService::completeRequest(Completion &completion) {
+    std::shared_ptr<CommandResData> respData = std::move(completion.respData);
+    ClientRequest client;
+    if (!m_clients.release(completion.clientId, client))
+        return;
+
+    LS::Message request(client.message);
+    if (respData->returnValue) {
+        //get response object based on command type
+        pbnjson::JValue responseObj = pbnjson::Object();
+        responseObj.put("returnValue", true);
+        parseResponseObject(responseObj, completion.type, std::move(respData));
+        LSUtils::postToClient(request, responseObj);
+    } else {
+        if (respData->error) {
+            LSUtils::respondWithError(request, respData->error->errorText, respData->error->errorCode);
         } else {
-            if (respData->error) {
-                LSUtils::respondWithError(request, respData->error->errorText, respData->error->errorCode);
-            } else {
-                LSUtils::respondWithError(request, CEC_ERR_UNKNOWN_ERROR);
-            }
+            LSUtils::respondWithError(request, CEC_ERR_UNKNOWN_ERROR);
         }
-        pThis->m_clients.erase(clientId);
     }
+    m_scheduler.complete(client.caller);
+    LSMessageUnref(client.message);
 }
 
 void CecLunaService::parseResponseObject(pbnjson::JValue &responseObj, enum CommandType type,
@@ -356,6 +802,7 @@ void CecLunaService::parseResponseObject(pbnjson::JValue &responseObj, enum Comm
                 device.put("cecVersion", cecDevice.getCecVersion());
                 device.put("powerStatus", cecDevice.getPowerStatus());
                 device.put("language", cecDevice.getLanguage());
+                device.put("adapter", cecDevice.getAdapter());
                 devicesArray.append(device);
             }
             responseObj.put("devices", devicesArray);
@@ -381,6 +828,32 @@ void CecLunaService::parseResponseObject(pbnjson::JValue &responseObj, enum Comm
             //Nothing to handle
             break;
         }
+        case CommandType::SEND_KEY: {
+            //Key lane requests are answered without a payload
+            break;
+        }
+        case CommandType::SEND_FRAME: {
+            AppLogDebug() <<__func__<<" parse send frame response\n";
+            std::shared_ptr<SendFrameResData> data = std::static_pointer_cast < SendFrameResData > (respData);
+
+            if (!data || !data->hasReply)
+                return;
+
+            pbnjson::JValue operandsArray = pbnjson::Array();
+            for (uint8_t i = 0; i < data->reply.length; i++) {
+                operandsArray.append((int) data->reply.operands[i]);
+            }
+            pbnjson::JValue reply = pbnjson::Object();
+            reply.put("initiator", (int) data->reply.initiator);
+            reply.put("destination", (int) data->reply.destination);
+            if (data->reply.hasOpcode) {
+                reply.put("opcode", (int) data->reply.opcode);
+                reply.put("name", cecOpcodeName(data->reply.opcode));
+            }
+            reply.put("operands", operandsArray);
+            responseObj.put("reply", reply);
+            break;
+        }
         case CommandType::GET_CONFIG: {
             AppLogDebug() <<__func__<<" parse getconfig response\n";
             std::shared_ptr<GetConfigResData> data = std::static_pointer_cast < GetConfigResData > (respData);
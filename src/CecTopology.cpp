@@ -0,0 +1,121 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+#include "CecTopology.h"
+
+CecTopology::CecTopology()
+{
+    rebuild(std::list<CecDevice>(), "");
+}
+
+uint8_t CecTopology::depthOf(uint16_t address)
+{
+    uint8_t depth = 4;
+    while (depth && !(address & 0x0F)) {
+        address >>= 4;
+        depth--;
+    }
+    return depth;
+}
+
+uint8_t CecTopology::inputOf(uint16_t address)
+{
+    uint8_t depth = depthOf(address);
+    if (!depth)
+        return 0;
+    return (address >> (4 * (4 - depth))) & 0x0F;
+}
+
+void CecTopology::rebuild(const std::list<CecDevice> &devices, const std::string &adapter)
+{
+    mNodes.clear();
+    mIndex.clear();
+    mNodes.push_back(Node{0x0000, -1, -1, 0, NO_NODE, NO_NODE, NO_NODE});
+    mIndex[0x0000] = 0;
+
+    for (const auto &device : devices) {
+        if (device.getAdapter() != adapter || device.getPhysicalAddress() == CEC_INVALID_PHYSICAL_ADDRESS)
+            continue;
+        Node &node = mNodes[insert(device.getPhysicalAddress())];
+        if (device.getLogicalAddress() >= 0 && device.getLogicalAddress() < CEC_BROADCAST_ADDRESS)
+            node.logicalAddress = static_cast<int8_t>(device.getLogicalAddress());
+    }
+
+    // Parents are always inserted before their children, so walking
+    // backwards sees every child before its parent.
+    for (size_t i = mNodes.size(); i-- > 0;) {
+        Node &node = mNodes[i];
+        node.device = node.logicalAddress;
+        for (uint8_t child = node.firstChild; node.device < 0 && child != NO_NODE; child = mNodes[child].nextSibling)
+            node.device = mNodes[child].device;
+    }
+}
+
+uint8_t CecTopology::insert(uint16_t address)
+{
+    auto it = mIndex.find(address);
+    if (it != mIndex.end())
+        return it->second;
+
+    uint8_t depth = depthOf(address);
+    uint16_t parentAddress = address & ~(0x0F << (4 * (4 - depth)));
+    uint8_t parent = insert(parentAddress);
+
+    uint8_t index = static_cast<uint8_t>(mNodes.size());
+    mNodes.push_back(Node{address, -1, -1, depth, parent, NO_NODE, NO_NODE});
+    mIndex[address] = index;
+
+    // Children are kept in input order
+    uint8_t *link = &mNodes[parent].firstChild;
+    while (*link != NO_NODE && mNodes[*link].address < address)
+        link = &mNodes[*link].nextSibling;
+    mNodes[index].nextSibling = *link;
+    *link = index;
+    return index;
+}
+
+const CecTopology::Node* CecTopology::find(uint16_t address) const
+{
+    auto it = mIndex.find(address);
+    if (it == mIndex.end())
+        return nullptr;
+    return &mNodes[it->second];
+}
+
+int CecTopology::deviceBehindInput(uint16_t address, uint8_t input) const
+{
+    uint8_t depth = depthOf(address);
+    if (depth >= 4 || !input || input > 0x0F)
+        return -1;
+    const Node *node = find(address | static_cast<uint16_t>(input << (4 * (3 - depth))));
+    return node ? node->device : -1;
+}
+
+std::vector<uint16_t> CecTopology::path(uint16_t address) const
+{
+    std::vector<uint16_t> nodes;
+    const Node *node = find(address);
+    if (!node)
+        return nodes;
+    nodes.resize(node->depth + 1);
+    for (size_t i = nodes.size(); i-- > 0; node = &mNodes[node->parent]) {
+        nodes[i] = node->address;
+        if (node->parent == NO_NODE)
+            break;
+    }
+    return nodes;
+}
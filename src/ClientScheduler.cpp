@@ -0,0 +1,207 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include <algorithm>
+
+#include "Logger.h"
+#include "ClientScheduler.h"
+
+ClientScheduler::ClientScheduler()
+    : mPumpScheduled(false)
+{
+}
+
+ClientScheduler::~ClientScheduler()
+{
+    g_idle_remove_by_data(this);
+}
+
+int ClientScheduler::callerWeight(const std::string &caller)
+{
+    if (caller.compare(0, 10, "com.webos.") == 0 || caller.compare(0, 8, "com.lge.") == 0)
+        return CLIENT_WEIGHT_SYSTEM;
+    return CLIENT_WEIGHT_APP;
+}
+
+ClientScheduler::Caller& ClientScheduler::getCaller(const std::string &caller)
+{
+    auto it = mCallers.find(caller);
+    if (it == mCallers.end()) {
+        it = mCallers.insert(std::make_pair(caller, Caller())).first;
+        it->second.weight = callerWeight(caller);
+        it->second.refilled = std::chrono::steady_clock::now();
+    }
+    return it->second;
+}
+
+void ClientScheduler::refill(Caller &entry, std::chrono::steady_clock::time_point now)
+{
+    double elapsed = std::chrono::duration<double>(now - entry.refilled).count();
+    entry.tokens = std::min<double>(CLIENT_RATE_BURST, entry.tokens + elapsed * CLIENT_RATE_PER_SEC);
+    entry.refilled = now;
+}
+
+// Called with mMutex held. Forgets callers with nothing queued or in
+// flight whose rate limit has recovered, they would start over the same.
+void ClientScheduler::pruneIdle()
+{
+    auto now = std::chrono::steady_clock::now();
+    for (auto it = mCallers.begin(); it != mCallers.end(); ) {
+        Caller &entry = it->second;
+        if (entry.pending || entry.dispatched || !entry.jobs.empty()) {
+            ++it;
+            continue;
+        }
+        refill(entry, now);
+        if (entry.tokens < CLIENT_RATE_BURST)
+            ++it;
+        else
+            it = mCallers.erase(it);
+    }
+}
+
+bool ClientScheduler::admit(const std::string &caller)
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    Caller &entry = getCaller(caller);
+    refill(entry, std::chrono::steady_clock::now());
+
+    if (entry.pending >= MAX_CLIENT_PENDING || entry.tokens < 1) {
+        AppLogWarningEvery(1000) << "Client " << caller << " is over its quota, pending: " << entry.pending;
+        return false;
+    }
+    entry.tokens -= 1;
+    return true;
+}
+
+void ClientScheduler::submit(const std::string &caller, ClientJobId id, ClientJob job, bool control)
+{
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        Caller &entry = getCaller(caller);
+        // A caller that was idle starts from the current virtual time and
+        // does not get credit for the time it sent nothing.
+        double finish = std::max(mVirtualTime, entry.lastFinish) + 1.0 / entry.weight;
+        entry.lastFinish = finish;
+        entry.pending++;
+        entry.jobs.push_back(Job{finish, id, std::move(job), control});
+    }
+    pump();
+}
+
+bool ClientScheduler::cancel(const std::string &caller, ClientJobId id)
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    auto found = mCallers.find(caller);
+    if (found == mCallers.end())
+        return false;
+    Caller &entry = found->second;
+    for (auto it = entry.jobs.begin(); it != entry.jobs.end(); ++it) {
+        if (it->id == id) {
+            // Its finish tag stays in lastFinish, the caller does not gain
+            // by cancelling.
+            entry.jobs.erase(it);
+            entry.pending--;
+            pruneIdle();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ClientScheduler::complete(const std::string &caller)
+{
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        auto found = mCallers.find(caller);
+        if (found != mCallers.end()) {
+            Caller &entry = found->second;
+            if (entry.pending > 0)
+                entry.pending--;
+            if (entry.dispatched > 0)
+                entry.dispatched--;
+        }
+        if (mDispatched > 0)
+            mDispatched--;
+        pruneIdle();
+    }
+    // Completions come from backend threads, requests start on the main loop
+    if (!mPumpScheduled.exchange(true))
+        g_idle_add(&ClientScheduler::pumpCb, this);
+}
+
+gboolean ClientScheduler::pumpCb(gpointer data)
+{
+    ClientScheduler *self = static_cast<ClientScheduler*>(data);
+    self->mPumpScheduled = false;
+    self->pump();
+    return G_SOURCE_REMOVE;
+}
+
+// Called with mMutex held. Platform callers are only held back by the
+// overall limit.
+bool ClientScheduler::canDispatch(const Caller &entry) const
+{
+    if (entry.weight == CLIENT_WEIGHT_SYSTEM)
+        return true;
+    return entry.dispatched < MAX_CLIENT_DISPATCHED
+            && mDispatched < MAX_DISPATCHED_REQUESTS - RESERVED_SYSTEM_DISPATCHED;
+}
+
+void ClientScheduler::pump()
+{
+    for (;;) {
+        ClientJob job;
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            // Control requests are short and the user is waiting on them,
+            // they go out at once. They still count as dispatched so
+            // complete() stays balanced.
+            Caller *next = nullptr;
+            std::deque<Job>::iterator pick;
+            for (auto &it : mCallers) {
+                pick = std::find_if(it.second.jobs.begin(), it.second.jobs.end(),
+                                    [](const Job &queued) { return queued.control; });
+                if (pick != it.second.jobs.end()) {
+                    next = &it.second;
+                    break;
+                }
+            }
+
+            if (!next) {
+                if (mDispatched >= MAX_DISPATCHED_REQUESTS)
+                    return;
+                for (auto &it : mCallers) {
+                    if (it.second.jobs.empty() || !canDispatch(it.second))
+                        continue;
+                    if (!next || it.second.jobs.front().finish < next->jobs.front().finish)
+                        next = &it.second;
+                }
+                if (!next)
+                    return;
+                pick = next->jobs.begin();
+                mVirtualTime = pick->finish;
+            }
+
+            job = std::move(pick->run);
+            next->jobs.erase(pick);
+            next->dispatched++;
+            mDispatched++;
+        }
+        // Run unlocked, the job may complete synchronously.
+        job();
+    }
+}
@@ -0,0 +1,86 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+#include "ClientTable.h"
+
+ClientTable::ClientTable()
+    : mSlots(CLIENT_TABLE_SLOTS), mFreeHead(0)
+{
+    for (uint32_t i = 0; i + 1 < CLIENT_TABLE_SLOTS; i++)
+        mSlots[i].nextFree = i + 1;
+}
+
+ClientTable::Slot* ClientTable::getSlot(ClientHandle handle)
+{
+    uint32_t index = handle & INDEX_MASK;
+    if (index >= mSlots.size())
+        return nullptr;
+    Slot &slot = mSlots[index];
+    if (!slot.used || slot.generation != (handle >> INDEX_BITS))
+        return nullptr;
+    return &slot;
+}
+
+ClientHandle ClientTable::insert(ClientRequest request)
+{
+    if (mFreeHead == NO_SLOT)
+        return INVALID_CLIENT_HANDLE;
+
+    uint32_t index = mFreeHead;
+    Slot &slot = mSlots[index];
+    mFreeHead = slot.nextFree;
+    slot.used = true;
+    slot.request = std::move(request);
+    return (slot.generation << INDEX_BITS) | index;
+}
+
+bool ClientTable::setCommand(ClientHandle handle, std::shared_ptr<Command> command)
+{
+    Slot *slot = getSlot(handle);
+    if (!slot)
+        return false;
+    slot->request.command = std::move(command);
+    return true;
+}
+
+bool ClientTable::release(ClientHandle handle, ClientRequest &request)
+{
+    Slot *slot = getSlot(handle);
+    if (!slot)
+        return false;
+
+    request = std::move(slot->request);
+    slot->request = ClientRequest();
+    slot->used = false;
+    // Generation 0 is skipped so no handle is ever 0
+    slot->generation = (slot->generation + 1) & GENERATION_MASK;
+    if (!slot->generation)
+        slot->generation = 1;
+    uint32_t index = handle & INDEX_MASK;
+    slot->nextFree = mFreeHead;
+    mFreeHead = index;
+    return true;
+}
+
+ClientHandle ClientTable::findToken(const std::string &token)
+{
+    for (uint32_t i = 0; i < mSlots.size(); i++) {
+        if (mSlots[i].used && mSlots[i].request.token == token)
+            return (mSlots[i].generation << INDEX_BITS) | i;
+    }
+    return INVALID_CLIENT_HANDLE;
+}
@@ -16,5 +16,49 @@
 
 #include <Logger.h>
 #include <PmLog.h>
+#include <PmLogLib.h>
+#include <cstring>
 
-pmlog::PmLog appLog("CEC");
+static const char APP_LOG_CONTEXT[] = "CEC";
+
+pmlog::PmLog appLog(APP_LOG_CONTEXT);
+
+// PmLog level of each AppLogLevel
+static const int pmLogLevels[] = {
+    kPmLogLevel_Debug,
+    kPmLogLevel_Info,
+    kPmLogLevel_Warning,
+    kPmLogLevel_Error,
+    kPmLogLevel_Critical
+};
+
+static PmLogContext appLogContext()
+{
+    static PmLogContext context = []() {
+        PmLogContext ctx = nullptr;
+        PmLogGetContext(APP_LOG_CONTEXT, &ctx);
+        return ctx;
+    }();
+    return context;
+}
+
+bool appLogSetLevel(const char *name)
+{
+    static const char *names[] = { "debug", "info", "warning", "error", "critical" };
+    for (int level = APP_LOG_LEVEL_DEBUG; level <= APP_LOG_LEVEL_CRITICAL; level++) {
+        if (!strcmp(name, names[level])) {
+            PmLogSetContextLevel(appLogContext(), pmLogLevels[level]);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool appLogContextEnabled(int level)
+{
+    int current;
+    // Let PmLog decide when the level cannot be read
+    if (PmLogGetContextLevel(appLogContext(), &current) != kPmLogErr_None)
+        return true;
+    return pmLogLevels[level] <= current;
+}
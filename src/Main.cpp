@@ -16,14 +16,36 @@
 
 #include <iostream>
 
+#include "CapabilityCache.h"
 #include "CecLunaService.h"
 #include "Logger.h"
+#include "MessageQueue.h"
+#include "NyxTrace.h"
+#include "ObjectPool.h"
 
 static gboolean option_version = FALSE;
+static gchar *option_record = NULL;
+static gchar *option_replay = NULL;
+static gboolean option_replay_fast = FALSE;
+static gchar *option_log_level = NULL;
+static gchar *option_engine = NULL;
+static gchar *option_capabilities = NULL;
 
 static GOptionEntry options[] = {
     { "version", 'v', 0, G_OPTION_ARG_NONE, &option_version,
       "Show version information and exit" },
+    { "record", 'r', 0, G_OPTION_ARG_FILENAME, &option_record,
+      "Record nyx traffic to FILE", "FILE" },
+    { "replay", 'p', 0, G_OPTION_ARG_FILENAME, &option_replay,
+      "Replay nyx traffic from FILE instead of using the CEC hardware", "FILE" },
+    { "replay-fast", 0, 0, G_OPTION_ARG_NONE, &option_replay_fast,
+      "Replay responses as fast as possible instead of with recorded timing" },
+    { "log-level", 'l', 0, G_OPTION_ARG_STRING, &option_log_level,
+      "Lowest level logged: debug, info, warning, error or critical (default: the PmLog setting)", "LEVEL" },
+    { "engine", 'e', 0, G_OPTION_ARG_STRING, &option_engine,
+      "Drive nyx I/O from a dispatch thread or the main loop: thread or loop (default thread)", "ENGINE" },
+    { "capabilities", 'c', 0, G_OPTION_ARG_FILENAME, &option_capabilities,
+      "Keep the commands devices do not support in FILE across restarts", "FILE" },
     { NULL },
 };
 
@@ -72,6 +94,28 @@ int main(int argc, char **argv)
 
         g_option_context_free(context);
 
+        if (option_log_level && !appLogSetLevel(option_log_level)) {
+            g_printerr("Unknown log level: %s\n", option_log_level);
+            exit(1);
+        }
+
+        if (option_engine) {
+            if (g_strcmp0(option_engine, "loop") == 0)
+                MessageQueue::setEngine(DISPATCH_ENGINE_LOOP);
+            else if (g_strcmp0(option_engine, "thread") != 0) {
+                g_printerr("Unknown engine: %s\n", option_engine);
+                exit(1);
+            }
+        }
+
+        if (option_replay)
+            NyxTrace::configure(option_replay_fast ? NYX_TRACE_REPLAY_FAST : NYX_TRACE_REPLAY, option_replay);
+        else if (option_record)
+            NyxTrace::configure(NYX_TRACE_RECORD, option_record);
+
+        if (option_capabilities)
+            CapabilityCache::configure(option_capabilities);
+
         signal(SIGTERM, term_handler);
         signal(SIGINT, term_handler);
         mainLoop = g_main_loop_new(NULL, FALSE);
@@ -83,6 +127,10 @@ int main(int argc, char **argv)
 
         g_main_loop_run(mainLoop);
         g_main_loop_unref(mainLoop);
+        CapabilityCache::instance().save();
+#ifdef ENABLE_ALLOC_STATS
+        AllocStats::log();
+#endif
     }
     catch (const std::length_error& le)
     {
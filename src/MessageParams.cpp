@@ -0,0 +1,113 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+#include <cstring>
+
+#include "MessageParams.h"
+
+static const char *paramKeyNames[] = {
+    "adapter",
+    "destAddress",
+    "timeout",
+    "cmd-name",
+    "pwr-state",
+    "aud-mute-status",
+    "volume",
+    "osd",
+    "set-active",
+    "active-source",
+    "vendor-id",
+    "version",
+    "name",
+    "language",
+    "is-active",
+    "payload",
+    "vendorId",
+    "powerState",
+    "physicalAddress",
+    "logicalAddress",
+    "deviceType"
+};
+
+static_assert(sizeof(paramKeyNames) / sizeof(paramKeyNames[0]) == PARAM_KEY_COUNT, "param key names out of sync");
+
+const char* paramKeyName(ParamKey key)
+{
+    return key < PARAM_KEY_COUNT ? paramKeyNames[key] : "";
+}
+
+bool findParamKey(const std::string &name, ParamKey &key)
+{
+    for (size_t i = 0; i < PARAM_KEY_COUNT; i++)
+    {
+        if (name == paramKeyNames[i])
+        {
+            key = static_cast<ParamKey>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool MessageParams::set(ParamKey key, std::string value)
+{
+    std::string *current = get(key);
+    if (current)
+    {
+        *current = std::move(value);
+        return true;
+    }
+    if (mSize == MAX_MESSAGE_PARAMS)
+        return false;
+    mParams[mSize].key = key;
+    mParams[mSize].value = std::move(value);
+    mSize++;
+    return true;
+}
+
+const std::string* MessageParams::get(ParamKey key) const
+{
+    for (size_t i = 0; i < mSize; i++)
+    {
+        if (mParams[i].key == key)
+            return &mParams[i].value;
+    }
+    return nullptr;
+}
+
+std::string* MessageParams::get(ParamKey key)
+{
+    return const_cast<std::string*>(static_cast<const MessageParams*>(this)->get(key));
+}
+
+bool MessageParams::writeTo(nyx_cec_command_t &command) const
+{
+    if (mSize > sizeof(command.params) / sizeof(command.params[0]))
+        return false;
+
+    for (size_t i = 0; i < mSize; i++)
+    {
+        const char *name = paramKeyName(mParams[i].key);
+        const std::string &value = mParams[i].value;
+        if (strlen(name) >= sizeof(command.params[i].name) || value.size() >= sizeof(command.params[i].value))
+            return false;
+        memcpy(command.params[i].name, name, strlen(name) + 1);
+        memcpy(command.params[i].value, value.c_str(), value.size() + 1);
+    }
+    command.size = mSize;
+    return true;
+}
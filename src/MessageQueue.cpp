@@ -14,16 +14,144 @@
 //
 // SPDX-License-Identifier: Apache-2.0
 
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sys/eventfd.h>
+
 #include "MessageQueue.h"
 
 static MessageQueue *objPtr;
-CommandType mType;
+
+DispatchEngine MessageQueue::sEngine = DISPATCH_ENGINE_THREAD;
+
+static int volumeStep(const MessageData &request)
+{
+    const std::string *volume = request.params.get(PARAM_VOLUME);
+    if (!volume)
+        return 0;
+    if (*volume == "up")
+        return 1;
+    if (*volume == "down")
+        return -1;
+    return 0;
+}
+
+static bool isVolumeStep(const MessageData &request)
+{
+    if (request.type != CommandType::SEND_COMMAND)
+        return false;
+    const std::string *name = request.params.get(PARAM_CMD_NAME);
+    return name && *name == "set-volume" && volumeStep(request);
+}
+
+// Sending these twice has the same effect as sending them once.
+static bool isIdempotent(const MessageData &request)
+{
+    switch (request.type)
+    {
+        case CommandType::LIST_ADAPTERS:
+        case CommandType::SCAN:
+        case CommandType::GET_CONFIG:
+            return true;
+        case CommandType::SEND_COMMAND:
+            break;
+        default:
+            return false;
+    }
+
+    const std::string *name = request.params.get(PARAM_CMD_NAME);
+    if (!name)
+        return false;
+    if (*name == "set-volume")
+        return !volumeStep(request);
+    return *name == "report-power-status" || *name == "report-audio-status"
+            || *name == "system-information" || *name == "active"
+            || *name == "one-touch-play" || *name == "osd-display";
+}
+
+// Same command, destination and args. The reply timeout does not matter.
+static bool isSameRequest(const MessageData &a, const MessageData &b)
+{
+    if (a.type != b.type || a.adapter != b.adapter)
+        return false;
+    for (const auto &param : a.params)
+    {
+        if (param.key == PARAM_TIMEOUT)
+            continue;
+        const std::string *other = b.params.get(param.key);
+        if (!other || *other != param.value)
+            return false;
+    }
+    for (const auto &param : b.params)
+    {
+        if (param.key != PARAM_TIMEOUT && !a.params.has(param.key))
+            return false;
+    }
+    return true;
+}
+
+static bool isSameVolumeTarget(const MessageData &a, const MessageData &b)
+{
+    static const ParamKey keys[] = { PARAM_ADAPTER, PARAM_DEST_ADDRESS };
+    for (auto key : keys)
+    {
+        const std::string *first = a.params.get(key);
+        const std::string *second = b.params.get(key);
+        if (!first != !second)
+            return false;
+        if (first && *first != *second)
+            return false;
+    }
+    return true;
+}
 
 MessageQueue::MessageQueue()
-    : mQuit(false)
+    : mQuit(false), mEventsScheduled(false), mDevice(nullptr), mPrimary(this), mEngine(sEngine)
 {
     objPtr = this;
+    mKeyMessage = std::make_shared<MessageData>();
+    mKeyMessage->type = SEND_KEY;
+    initKeyCommand();
+    mWorker.setHandler([this](std::shared_ptr<MessageData> request, ResponseBuffer resp) {
+        mCb(std::move(request), std::move(resp));
+    });
+
+    if (mEngine == DISPATCH_ENGINE_LOOP)
+    {
+        mWakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (mWakeFd < 0)
+        {
+            AppLogError() <<__func__<<": eventfd failed, using the thread engine: "<<strerror(errno)<<"\n";
+            mEngine = DISPATCH_ENGINE_THREAD;
+        }
+        else
+        {
+            GIOChannel *channel = g_io_channel_unix_new(mWakeFd);
+            mWakeWatch = g_io_add_watch(channel, G_IO_IN, &MessageQueue::wakeCb, this);
+            g_io_channel_unref(channel);
+        }
+    }
     init();
+
+    if (mEngine == DISPATCH_ENGINE_THREAD)
+    {
+        mWorker.start();
+        mThread = std::thread(std::bind(&MessageQueue::dispatchMessage, this));
+    }
+}
+
+MessageQueue::MessageQueue(MessageQueue *primary)
+    : mQuit(false), mEventsScheduled(false), mDevice(primary->mDevice), mPrimary(primary),
+      mOwnsDevice(false), mEngine(DISPATCH_ENGINE_THREAD)
+{
+    mKeyMessage = std::make_shared<MessageData>();
+    mKeyMessage->type = SEND_KEY;
+    initKeyCommand();
+    mWorker.setHandler([this](std::shared_ptr<MessageData> request, ResponseBuffer resp) {
+        mCb(std::move(request), std::move(resp));
+    });
+    mWorker.start();
     mThread = std::thread(std::bind(&MessageQueue::dispatchMessage, this));
 }
 
@@ -36,12 +164,50 @@ MessageQueue::~MessageQueue()
         mThread.join();
     }
     mQueue.clear();
+    if (!mOwnsDevice)
+    {
+        // Replies still due for this engine are dropped by the primary,
+        // the ones on their way in are waited for
+        std::unique_lock<std::mutex> lock(mPrimary->mInFlightMutex);
+        for (auto &sent : mPrimary->mInFlight)
+        {
+            if (sent.engine == this)
+                sent.engine = nullptr;
+        }
+        mPrimary->mDeliveredCond.wait(lock, [this]() { return mDelivering == 0; });
+    }
+    g_idle_remove_by_data(this);
+    if (mWakeWatch)
+        g_source_remove(mWakeWatch);
+    if (mTimer)
+        g_source_remove(mTimer);
+    if (mWakeFd >= 0)
+        close(mWakeFd);
+    if (mPlayer)
+    {
+        mPlayer.reset();
+        mWorker.stop();
+        return;
+    }
+    mWorker.stop();
+    if (!mOwnsDevice)
+        return;
     nyx_device_close(mDevice);
     nyx_deinit();
 }
 
 void MessageQueue::init()
 {
+    NyxTraceMode traceMode = NyxTrace::getMode();
+    if (traceMode == NYX_TRACE_REPLAY || traceMode == NYX_TRACE_REPLAY_FAST)
+    {
+        mPlayer.reset(new NyxTracePlayer(NyxTrace::getPath(), traceMode == NYX_TRACE_REPLAY,
+                std::bind(&MessageQueue::deliverResponse, this, std::placeholders::_1)));
+        return;
+    }
+    if (traceMode == NYX_TRACE_RECORD)
+        mRecorder.reset(new NyxTraceRecorder(NyxTrace::getPath()));
+
     nyx_error_t error = nyx_init();
     if (NYX_ERROR_NONE == error)
     {
@@ -65,60 +231,505 @@ void MessageQueue::setCallback(MsgCallback cb)
 void MessageQueue::nyxCallback(nyx_cec_response_t *response)
 {
     AppLogDebug() <<__func__ << "Received :\n";
-    std::vector<std::string> resp;
-    for(int i=0;i<response->size;i++)
+    ResponseBuffer resp(*response);
+    for (const auto &line : resp)
+        AppLogDebug() <<line<<"\n";
+    // The primary matches replies to the sends of every engine
+    objPtr->deliverResponse(std::move(resp));
+}
+
+void MessageQueue::setEventCallback(EventCallback cb)
+{
+    mEventCb = std::move(cb);
+}
+
+void MessageQueue::onResponse(ResponseBuffer resp)
+{
+    if (mRecorder)
+        mRecorder->recordResponse(resp);
+
+    if (postEvents(resp))
+        return;
+
+    InFlight sent;
     {
-        AppLogDebug() <<response->responses[i]<<"\n";
-        resp.push_back(response->responses[i]);
+        std::unique_lock<std::mutex> lock(mInFlightMutex);
+        if (mInFlight.empty())
+        {
+            AppLogWarningEvery(1000) <<__func__<<": Dropping response with no command in flight\n";
+            return;
+        }
+        sent = std::move(mInFlight.front());
+        mInFlight.pop_front();
+        // Key frames are fire and forget, nobody waits for their reply.
+        if (!sent.engine || sent.request->type == SEND_KEY)
+            return;
+        sent.engine->mDelivering++;
     }
-    objPtr->mCb(mType,std::move(resp));
+    if (!sent.engine->nextVolumeStep(sent.request, resp))
+        sent.engine->mWorker.post(std::move(sent.request), std::move(resp));
+
+    std::unique_lock<std::mutex> lock(mInFlightMutex);
+    if (!--sent.engine->mDelivering)
+        mDeliveredCond.notify_all();
+}
+
+// Replies made up here never reach the trace, replay makes them up again
+void MessageQueue::respond(std::shared_ptr<MessageData> request, ResponseBuffer resp)
+{
+    mWorker.post(std::move(request), std::move(resp));
+}
+
+// For replies to a command already in the trace
+void MessageQueue::respondTraced(std::shared_ptr<MessageData> request, ResponseBuffer resp)
+{
+    if (mRecorder)
+        mRecorder->recordResponse(resp);
+    respond(std::move(request), std::move(resp));
+}
+
+// "adapter: cec1", sent along with events by backends serving several
+// adapters
+static bool parseAdapterLine(const LineView &line, std::string &adapter)
+{
+    size_t pos = line.find_first_not_of(" \t");
+    if (pos == LineView::npos || line.find("adapter:", pos) != pos)
+        return false;
+    pos = line.find_first_not_of(" \t", pos + strlen("adapter:"));
+    if (pos == LineView::npos)
+        return false;
+    adapter = line.substr(pos);
+    return true;
+}
+
+bool MessageQueue::postEvents(const ResponseBuffer &resp)
+{
+    CecFrame frame;
+    Event event;
+    event.adapter = DEFAULT_CEC_ADAPTER;
+    bool hasFrame = false;
+    for (const auto &line : resp)
+    {
+        if (parseIncomingFrame(line, frame))
+            hasFrame = true;
+        else if (!parseAdapterLine(line, event.adapter))
+            return false;
+    }
+    if (!hasFrame)
+        return false;
+
+    for (const auto &line : resp)
+    {
+        if (!parseIncomingFrame(line, event.frame))
+            continue;
+        AppLogDebug() <<__func__<<": Event "<<cecOpcodeName(event.frame.opcode)<<" from "<<(int)event.frame.initiator
+                <<" on "<<event.adapter<<"\n";
+        if (!mEvents.push(event))
+            AppLogWarningEvery(1000) <<__func__<<": Event queue full, dropping event\n";
+    }
+
+    if (!mEventsScheduled.exchange(true))
+        g_idle_add(&MessageQueue::drainEvents, this);
+    return true;
+}
+
+gboolean MessageQueue::drainEvents(gpointer data)
+{
+    MessageQueue *self = static_cast<MessageQueue*>(data);
+    self->mEventsScheduled = false;
+
+    Event event;
+    while (self->mEvents.pop(event))
+    {
+        if (self->mEventCb)
+            self->mEventCb(event.adapter, event.frame);
+    }
+    return G_SOURCE_REMOVE;
+}
+
+void MessageQueue::pushInFlight(std::shared_ptr<MessageData> request)
+{
+    std::unique_lock<std::mutex> lock(mPrimary->mInFlightMutex);
+    mPrimary->mInFlight.push_back(InFlight{this, std::move(request)});
+}
+
+void MessageQueue::popInFlight()
+{
+    std::unique_lock<std::mutex> lock(mPrimary->mInFlightMutex);
+    if (!mPrimary->mInFlight.empty())
+        mPrimary->mInFlight.pop_back();
+}
+
+bool MessageQueue::traceConfig(std::shared_ptr<MessageData> request, const char *name, const char *key, const char *value)
+{
+    if (!mPlayer && !mRecorder)
+        return false;
+
+    nyx_cec_command_t command = {0};
+    strncpy(command.name, name, sizeof(command.name) - 1);
+    command.size = 1;
+    strncpy(command.params[0].name, key ? key : "", sizeof(command.params[0].name) - 1);
+    strncpy(command.params[0].value, value ? value : "", sizeof(command.params[0].value) - 1);
+
+    if (mPlayer)
+    {
+        pushInFlight(request);
+        mPlayer->replayCommand(command);
+        return true;
+    }
+    mRecorder->recordCommand(command);
+    return false;
 }
 
 void MessageQueue::sendCommand(std::shared_ptr<MessageData> request)
 {
     AppLogDebug() <<__func__<<"\n";
-    mType = request->type;
 
-    nyx_error_t error;
+    std::string *volume = request->params.get(PARAM_VOLUME);
+    if (request->volumeSteps && volume)
+        *volume = request->volumeSteps > 0 ? "up" : "down";
+    else if (isVolumeStep(*request))
+    {
+        // Steps that cancelled out while queued, nothing to send
+        ResponseBuffer resp("response: success");
+        respond(request, std::move(resp));
+        return;
+    }
+
     nyx_cec_command_t command = {0};
-    command.size = request->params.size();
     if(request->type == CommandType::SCAN)
         strcpy(command.name,"scan");
     else if(request->type == CommandType::LIST_ADAPTERS)
         strcpy(command.name,"listAdapters");
     else if(request->type == CommandType::SEND_COMMAND)
-        strcpy(command.name,request->params["cmd-name"].c_str());
+    {
+        const std::string *name = request->params.get(PARAM_CMD_NAME);
+        if (name)
+            strncpy(command.name, name->c_str(), sizeof(command.name) - 1);
+    }
     AppLogDebug() <<"COMMAND NAME : [ "<<command.name<<" ]"<<"\n";
-    size_t i = 0;
-    for(const auto &it : request->params) {
-        strcpy(command.params[i].name,it.first.c_str());
-        strcpy(command.params[i].value,it.second.c_str());
+    if (!request->params.writeTo(command))
+    {
+        AppLogError() <<__func__<<": Params do not fit the nyx command\n";
+        ResponseBuffer resp("response: failed");
+        respond(request, std::move(resp));
+        return;
+    }
+    for (int i = 0; i < command.size; i++)
         AppLogDebug() <<"Name : [ "<<command.params[i].name<<" ]" <<" Value : ["<<command.params[i].value<<" ]"<<"\n";
-        i++;
+    submitCommand(request, command);
+}
+
+// nyx has no raw frame entry point, frames are written straight into a
+// vendor-commands request without going through the params list.
+// vendor-commands wants a payload, a <Polling Message> has none and is only
+// sent when the backend is known to take an empty one as a poll.
+void MessageQueue::sendFrame(std::shared_ptr<MessageData> request)
+{
+    const CecFrame &frame = request->frame;
+#ifndef NYX_RAW_POLLS
+    if (!frame.hasOpcode)
+    {
+        AppLogError() <<__func__<<": Backend cannot send a polling message\n";
+        ResponseBuffer resp("response: unsupported");
+        respond(request, std::move(resp));
+        return;
+    }
+#endif
+    nyx_cec_command_t command = {0};
+    strncpy(command.name, "vendor-commands", sizeof(command.name) - 1);
+    command.size = 3;
+    strncpy(command.params[0].name, "adapter", sizeof(command.params[0].name) - 1);
+    strncpy(command.params[0].value, request->adapter.c_str(), sizeof(command.params[0].value) - 1);
+    strncpy(command.params[1].name, "destAddress", sizeof(command.params[1].name) - 1);
+    snprintf(command.params[1].value, sizeof(command.params[1].value), "%d", frame.destination);
+    strncpy(command.params[2].name, "payload", sizeof(command.params[2].name) - 1);
+    if (!encodeCecPayload(frame, command.params[2].value, sizeof(command.params[2].value)))
+    {
+        AppLogError() <<__func__<<": Frame does not fit the nyx payload\n";
+        ResponseBuffer resp("response: failed");
+        respond(request, std::move(resp));
+        return;
+    }
+    AppLogDebug() <<__func__<<": "<<cecOpcodeName(frame.opcode)<<" to "<<(int)frame.destination
+            <<" [ "<<command.params[2].value<<" ]\n";
+    submitCommand(request, command);
+}
+
+void MessageQueue::submitCommand(std::shared_ptr<MessageData> request, nyx_cec_command_t &command)
+{
+    nyx_error_t error;
+    if (mPlayer)
+    {
+        pushInFlight(request);
+        mPlayer->replayCommand(command);
+        return;
+    }
+    {
+        std::unique_lock<std::mutex> lock(mPrimary->mSendMutex);
+        // Registered before sending, the reply may arrive before nyx returns.
+        pushInFlight(request);
+        if (mRecorder)
+            mRecorder->recordCommand(command);
+        error = nyx_cec_send_command(mDevice, &command);
+        if (error != NYX_ERROR_NONE)
+            popInFlight();
     }
-    error = nyx_cec_send_command(mDevice, &command);
     if(error == NYX_ERROR_NOT_IMPLEMENTED)
     {
         AppLogDebug() <<__func__<<": NYX_ERROR_NOT_IMPLEMENTED\n";
-        std::vector<std::string> resp;
-        std::string reply = "response: success";
-        resp.push_back(reply);
-        mCb(mType,std::move(resp));
+        ResponseBuffer resp("response: success");
+        respondTraced(request, std::move(resp));
     }
     else if(error != NYX_ERROR_NONE)
     {
         AppLogError() <<__func__<<": Failed with :"<<error<<"\n";
-        std::vector<std::string> resp;
-        std::string reply = "response: failed";
-        resp.push_back(reply);
-        mCb(mType,std::move(resp));
+        ResponseBuffer resp("response: failed");
+        respondTraced(request, std::move(resp));
     }
 }
 
+void MessageQueue::initKeyCommand()
+{
+    mKeyCommand = nyx_cec_command_t();
+    strncpy(mKeyCommand.name, "vendor-commands", sizeof(mKeyCommand.name) - 1);
+    mKeyCommand.size = 3;
+    strncpy(mKeyCommand.params[0].name, "adapter", sizeof(mKeyCommand.params[0].name) - 1);
+    strncpy(mKeyCommand.params[1].name, "destAddress", sizeof(mKeyCommand.params[1].name) - 1);
+    strncpy(mKeyCommand.params[2].name, "payload", sizeof(mKeyCommand.params[2].name) - 1);
+}
+
+void MessageQueue::sendKeyFrame(const KeyFrame &key)
+{
+    // Keys are never held back for the bus, later messages pay for them.
+    mBus.charge(key.adapter.empty() ? DEFAULT_CEC_ADAPTER : key.adapter,
+            BusScheduler::frameTime(key.pressed ? 3 : 2), std::chrono::steady_clock::now());
+
+    strncpy(mKeyCommand.params[0].value, key.adapter.c_str(), sizeof(mKeyCommand.params[0].value) - 1);
+    snprintf(mKeyCommand.params[1].value, sizeof(mKeyCommand.params[1].value), "%d", key.destination);
+    if (key.pressed)
+        snprintf(mKeyCommand.params[2].value, sizeof(mKeyCommand.params[2].value), "%02x:%02x",
+                CEC_OPCODE_USER_CONTROL_PRESSED, key.keyCode);
+    else
+        snprintf(mKeyCommand.params[2].value, sizeof(mKeyCommand.params[2].value), "%02x",
+                CEC_OPCODE_USER_CONTROL_RELEASED);
+
+    if (mPlayer)
+    {
+        pushInFlight(mKeyMessage);
+        mPlayer->replayCommand(mKeyCommand);
+        return;
+    }
+    std::unique_lock<std::mutex> lock(mPrimary->mSendMutex);
+    pushInFlight(mKeyMessage);
+    if (mRecorder)
+        mRecorder->recordCommand(mKeyCommand);
+    nyx_error_t error = nyx_cec_send_command(mDevice, &mKeyCommand);
+    if (error != NYX_ERROR_NONE)
+    {
+        popInFlight();
+        if (error != NYX_ERROR_NOT_IMPLEMENTED)
+            AppLogError() <<__func__<<": Failed with :"<<error<<"\n";
+    }
+}
+
+// Bus time of a queued message: the frames it puts on the wire and the
+// replies it asks for, following what the backend sends for each command.
+static int64_t estimateBusTime(const MessageData &request)
+{
+    switch (request.type)
+    {
+        case CommandType::SEND_FRAME:
+            return BusScheduler::frameTime(request.frame.hasOpcode ? 2 + request.frame.length : 1);
+        case CommandType::SCAN:
+            // Polls every logical address, replies from found devices are
+            // not known up front.
+            return (CEC_BROADCAST_ADDRESS - 1) * BusScheduler::frameTime(1);
+        case CommandType::SEND_COMMAND:
+            break;
+        default:
+            // Adapter queries and config never touch the bus
+            return 0;
+    }
+
+    const std::string *name = request.params.get(PARAM_CMD_NAME);
+    if (!name)
+        return 0;
+    if (*name == "set-volume")
+        return BusScheduler::frameTime(3) + BusScheduler::frameTime(2) + BusScheduler::frameTime(3);
+    if (*name == "active")
+        return BusScheduler::frameTime(4);
+    if (*name == "one-touch-play")
+        return BusScheduler::frameTime(2) + BusScheduler::frameTime(4);
+    if (*name == "osd-display")
+    {
+        const std::string *osd = request.params.get(PARAM_OSD);
+        size_t length = !osd ? 0 : std::min<size_t>(osd->size(), CEC_MAX_OPERANDS - 1);
+        return BusScheduler::frameTime(3 + length);
+    }
+    if (*name == "vendor-commands")
+    {
+        const std::string *payload = request.params.get(PARAM_PAYLOAD);
+        size_t length = !payload ? 0 : (payload->size() + 1) / 3;
+        return BusScheduler::frameTime(1 + length);
+    }
+    if (*name == "system-information")
+    {
+        int64_t cost = 0;
+        for (auto &param : request.params)
+        {
+            if (param.key != PARAM_ADAPTER && param.key != PARAM_DEST_ADDRESS && param.key != PARAM_TIMEOUT
+                    && param.key != PARAM_CMD_NAME)
+                cost += BusScheduler::frameTime(2) + BusScheduler::frameTime(5);
+        }
+        return cost;
+    }
+    // Status queries: request and report
+    return BusScheduler::frameTime(2) + BusScheduler::frameTime(3);
+}
+
+static std::string busAdapter(const MessageData &request)
+{
+    const std::string *param = request.params.get(PARAM_ADAPTER);
+    const std::string &adapter = param ? *param : request.adapter;
+    return adapter.empty() ? DEFAULT_CEC_ADAPTER : adapter;
+}
+
+// Called with mMutex held. Returns false and sets the ready time of the
+// adapter when it has no bus time left for the message.
+bool MessageQueue::paceMessage(const MessageData &request, std::chrono::steady_clock::time_point now)
+{
+    int64_t cost = estimateBusTime(request);
+    if (!cost)
+        return true;
+
+    std::string adapter = busAdapter(request);
+    auto wait = mBus.acquire(adapter, cost, now);
+    if (wait.count() == 0)
+    {
+        mBusReadyAt.erase(adapter);
+        return true;
+    }
+    mBusReadyAt[adapter] = now + wait;
+    return false;
+}
+
+// Called with mMutex held. False while the adapter of the message waits for
+// bus time, messages that do not touch the bus never wait.
+bool MessageQueue::hasBusTime(const MessageData &request, std::chrono::steady_clock::time_point now) const
+{
+    if (mBusReadyAt.empty() || !estimateBusTime(request))
+        return true;
+    auto it = mBusReadyAt.find(busAdapter(request));
+    return it == mBusReadyAt.end() || now >= it->second;
+}
+
+// Called with mMutex held. Removes cancelled messages and messages that
+// can no longer go out before their deadline, and returns the one to send next: lowest priority
+// class, then earliest deadline, then arrival order. Messages for an adapter
+// out of bus time are skipped, end() when none is left.
+std::vector<std::shared_ptr<MessageData>>::iterator MessageQueue::nextMessage(std::chrono::steady_clock::time_point now,
+        std::vector<std::shared_ptr<MessageData>> &expired)
+{
+    for (auto it = mQueue.begin(); it != mQueue.end();)
+    {
+        const MessageData &request = **it;
+        // Nobody is waiting for it any more, drop it without a response
+        if (request.isCancelled())
+        {
+            AppLogDebug() <<__func__<<": Dropping cancelled message\n";
+            it = mQueue.erase(it);
+            continue;
+        }
+        // A message that already went out once, a volume step or a
+        // retry, is finished rather than dropped halfway.
+        if (!request.dispatched && request.deadline != std::chrono::steady_clock::time_point::max()
+                && now + std::chrono::microseconds(estimateBusTime(request)) > request.deadline)
+        {
+            expired.push_back(std::move(*it));
+            it = mQueue.erase(it);
+            continue;
+        }
+        ++it;
+    }
+
+    auto best = mQueue.end();
+    for (auto it = mQueue.begin(); it != mQueue.end(); ++it)
+    {
+        if (!hasBusTime(**it, now))
+            continue;
+        if (best == mQueue.end() || (*it)->priority < (*best)->priority
+                || ((*it)->priority == (*best)->priority && (*it)->deadline < (*best)->deadline))
+            best = it;
+    }
+    return best;
+}
+
+std::vector<BusStatus> MessageQueue::getBusStatus()
+{
+    return mBus.getStatus();
+}
+
+bool MessageQueue::sendKey(const KeyFrame &key)
+{
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        if (mKeyCount == KEY_LANE_SIZE)
+            return false;
+        // Any other key event ends a key being held
+        mHeldKey.active = false;
+        mKeyLane[(mKeyHead + mKeyCount) % KEY_LANE_SIZE] = key;
+        mKeyCount++;
+    }
+    wake();
+    return true;
+}
+
+bool MessageQueue::holdKey(const KeyFrame &key, std::chrono::milliseconds interval, std::chrono::milliseconds timeout)
+{
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        if (mKeyCount == KEY_LANE_SIZE)
+            return false;
+        mKeyLane[(mKeyHead + mKeyCount) % KEY_LANE_SIZE] = key;
+        mKeyCount++;
+
+        auto now = std::chrono::steady_clock::now();
+        mHeldKey.active = true;
+        mHeldKey.frame = key;
+        mHeldKey.interval = interval;
+        mHeldKey.next = now + interval;
+        mHeldKey.until = now + timeout;
+    }
+    wake();
+    return true;
+}
+
+// Called with mMutex held and the key lane empty. Repeats that fell behind
+// are collapsed into a single press instead of being sent back to back.
+void MessageQueue::repeatHeldKey(std::chrono::steady_clock::time_point now)
+{
+    if (now < mHeldKey.next)
+        return;
+
+    KeyFrame key = mHeldKey.frame;
+    if (now >= mHeldKey.until)
+    {
+        AppLogInfo() <<__func__<<": key hold timed out, releasing\n";
+        key.pressed = false;
+        mHeldKey.active = false;
+    }
+    else
+    {
+        mHeldKey.next = now + mHeldKey.interval;
+    }
+    mKeyLane[(mKeyHead + mKeyCount) % KEY_LANE_SIZE] = key;
+    mKeyCount++;
+}
+
 void MessageQueue::getConfig(std::shared_ptr<MessageData> request)
 {
     AppLogDebug() <<__func__<<"\n";
-    mType = request->type;
 
     nyx_error_t error;
     char *configName = nullptr;
@@ -126,29 +737,34 @@ void MessageQueue::getConfig(std::shared_ptr<MessageData> request)
 
     for(const auto &it : request->params) {
         AppLogDebug() <<__func__<<" Updating param"<<"\n";
-        if(it.first != "adapter") {
+        if(it.key != PARAM_ADAPTER) {
             if(configName != nullptr){
                delete[] configName;
             }
-            configName = new char[it.first.size() + 1];
-            strcpy(configName,it.first.c_str());
+            const char *name = paramKeyName(it.key);
+            configName = new char[strlen(name) + 1];
+            strcpy(configName,name);
         }
     }
 
+    if (traceConfig(request, "getConfig", configName, nullptr))
+    {
+        delete[] configName;
+        delete[] value;
+        return;
+    }
+
     error = nyx_cec_get_config(mDevice, configName, &value);
     if(error != NYX_ERROR_NONE)
     {
         AppLogError() <<__func__<<": Failed with :"<<error<<"\n";
-        std::vector<std::string> resp;
-        std::string reply = "response: failed";
-        resp.push_back(reply);
-        mCb(mType,std::move(resp));
+        ResponseBuffer resp("response: failed");
+        respondTraced(request, std::move(resp));
     }
     else {
         AppLogDebug() <<__func__<<": Value :"<<value<<"\n";
-        std::vector<std::string> resp;
-        resp.push_back(value);
-        mCb(mType,std::move(resp));
+        ResponseBuffer resp(value);
+        respondTraced(request, std::move(resp));
     }
     if (configName != nullptr)
       delete[] configName;
@@ -158,41 +774,44 @@ void MessageQueue::getConfig(std::shared_ptr<MessageData> request)
 void MessageQueue::setConfig(std::shared_ptr<MessageData> request)
 {
     AppLogDebug() <<__func__<<"\n";
-    mType = request->type;
 
     nyx_error_t error;
     char *type = nullptr;
     char *value = nullptr;
     for (const auto &it : request->params) {
-        if(it.first != "adapter") {
+        if(it.key != PARAM_ADAPTER) {
             if(type != nullptr){
                delete[] type;
             }
-            type = new char[it.first.size()+1];
-            strcpy(type,it.first.c_str());
+            const char *name = paramKeyName(it.key);
+            type = new char[strlen(name)+1];
+            strcpy(type,name);
             if(value != nullptr){
                delete[] value;
             }
-            value = new char[it.second.size()+1];
-            strcpy(value,it.second.c_str());
+            value = new char[it.value.size()+1];
+            strcpy(value,it.value.c_str());
         }
     }
+    if (traceConfig(request, "setConfig", type, value))
+    {
+        delete[] type;
+        delete[] value;
+        return;
+    }
+
     error = nyx_cec_set_config(mDevice, type, value);
     if((error == NYX_ERROR_NOT_IMPLEMENTED) || (error == NYX_ERROR_NONE))
     {
         AppLogDebug() <<__func__<<": NYX_ERROR_NOT_IMPLEMENTED s\n";
-        std::vector<std::string> resp;
-        std::string reply = "response: success";
-        resp.push_back(reply);
-        mCb(mType,std::move(resp));
+        ResponseBuffer resp("response: success");
+        respondTraced(request, std::move(resp));
     }
     else  if (NYX_ERROR_NONE != error)
     {
         AppLogError() <<__func__<<": Failed with :"<<error<<"\n";
-        std::vector<std::string> resp;
-        std::string reply = "response: failed";
-        resp.push_back(reply);
-        mCb(mType,std::move(resp));
+        ResponseBuffer resp("response: failed");
+        respondTraced(request, std::move(resp));
     }
 
     if (type != nullptr)
@@ -224,6 +843,12 @@ bool MessageQueue::handleMessage(std::shared_ptr<MessageData> request)
             sendCommand(request);
         }
         break;
+        case CommandType::SEND_FRAME:
+        {
+            AppLogDebug() <<__func__<<":SEND_FRAME MessageType\n";
+            sendFrame(request);
+        }
+        break;
         case CommandType::GET_CONFIG:
         {
             AppLogDebug() <<__func__<<":GET_CONFIG MessageType\n";
@@ -243,15 +868,144 @@ bool MessageQueue::handleMessage(std::shared_ptr<MessageData> request)
     return true;
 }
 
+// Called with mMutex held. Merges the request into a message that is
+// still queued, the queued message answers all merged commands.
+bool MessageQueue::coalesce(const std::shared_ptr<MessageData> &request)
+{
+    bool volume = isVolumeStep(*request);
+    if (volume && !request->volumeSteps)
+        request->volumeSteps = volumeStep(*request);
+    if (!volume && !isIdempotent(*request))
+        return false;
+
+    for (auto &queued : mQueue)
+    {
+        if (volume)
+        {
+            if (!isVolumeStep(*queued) || !isSameVolumeTarget(*queued, *request))
+                continue;
+            queued->volumeSteps += request->volumeSteps;
+        }
+        else if (!isSameRequest(*queued, *request))
+        {
+            continue;
+        }
+
+        // The merged message has to satisfy its most urgent command
+        queued->priority = std::min(queued->priority, request->priority);
+        queued->deadline = std::min(queued->deadline, request->deadline);
+        if (request->command)
+            queued->waiters.push_back(request->command);
+        queued->waiters.insert(queued->waiters.end(), request->waiters.begin(), request->waiters.end());
+        AppLogDebug() <<__func__<<": merged into queued message, "<<queued->waiters.size()<<" waiting\n";
+        return true;
+    }
+    return false;
+}
+
+// Volume steps go out one frame at a time. Until the last one is sent the
+// message goes back to the head of the queue instead of being answered.
+bool MessageQueue::nextVolumeStep(const std::shared_ptr<MessageData> &request, const ResponseBuffer &resp)
+{
+    if ((request->volumeSteps >= -1 && request->volumeSteps <= 1) || request->isCancelled())
+        return false;
+    for (const auto &line : resp)
+    {
+        if (line.find("response") != std::string::npos && line.find("failed") != std::string::npos)
+            return false;
+    }
+
+    request->volumeSteps += request->volumeSteps > 0 ? -1 : 1;
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mQueue.insert(mQueue.begin(), request);
+    }
+    wake();
+    return true;
+}
+
 void MessageQueue::addMessage(std::shared_ptr<MessageData> request)
 {
-    AppLogInfo() <<__func__ << " called \n";
+    AppLogDebug() <<__func__ << " called \n";
     {
         std::unique_lock<std::mutex> lock(mMutex);
-        mQueue.push_back(request);
+        if (!coalesce(request))
+            mQueue.push_back(request);
     }
 
-    mCondVar.notify_one();
+    wake();
+}
+
+// Called with mMutex held
+bool MessageQueue::isReady(std::chrono::steady_clock::time_point now) const
+{
+    if (mKeyCount || (mHeldKey.active && now >= mHeldKey.next))
+        return true;
+    for (const auto &request : mQueue)
+    {
+        if (hasBusTime(*request, now))
+            return true;
+    }
+    return false;
+}
+
+// Called with mMutex held. When the dispatcher has timed work without
+// being woken: a held key repeat or a paced message getting bus time.
+std::chrono::steady_clock::time_point MessageQueue::nextWakeup() const
+{
+    auto until = std::chrono::steady_clock::time_point::max();
+    if (mHeldKey.active)
+        until = mHeldKey.next;
+    for (const auto &request : mQueue)
+    {
+        auto it = mBusReadyAt.find(busAdapter(*request));
+        if (it != mBusReadyAt.end() && it->second < until)
+            until = it->second;
+    }
+    return until;
+}
+
+// Sends at most one key frame or message. Called with the lock held,
+// returns with it released.
+void MessageQueue::dispatchStep(std::unique_lock<std::mutex> &lock)
+{
+    auto now = std::chrono::steady_clock::now();
+    if (mHeldKey.active && !mKeyCount)
+        repeatHeldKey(now);
+    if (mKeyCount)
+    {
+        KeyFrame key = mKeyLane[mKeyHead];
+        mKeyHead = (mKeyHead + 1) % KEY_LANE_SIZE;
+        mKeyCount--;
+        lock.unlock();
+        sendKeyFrame(key);
+    }
+    else if (mQueue.size())
+    {
+        std::vector<std::shared_ptr<MessageData>> expired;
+        std::shared_ptr<MessageData> next;
+        auto it = nextMessage(now, expired);
+        if (it != mQueue.end() && paceMessage(**it, now))
+        {
+            next = std::move(*it);
+            mQueue.erase(it);
+            next->dispatched = true;
+        }
+        lock.unlock();
+        for (auto &request : expired)
+        {
+            AppLogWarningEvery(1000) <<__func__<<": Deadline exceeded before dispatch\n";
+            ResponseBuffer resp(RESPONSE_DEADLINE_EXCEEDED.c_str());
+            mWorker.post(std::move(request), std::move(resp));
+        }
+        if (next)
+            handleMessage(std::move(next));
+    }
+    else
+    {
+        //woken up for a held key repeat or bus time that is not due yet
+        lock.unlock();
+    }
 }
 
 void MessageQueue::dispatchMessage()
@@ -260,20 +1014,101 @@ void MessageQueue::dispatchMessage()
     std::unique_lock < std::mutex > lock(mMutex, std::defer_lock);
     do {
         lock.lock();
-        mCondVar.wait(lock, [this] {
-            return (mQueue.size() || mQuit);
-        });
-        if (mQueue.size() && !mQuit)
-        {
-            std::shared_ptr<MessageData> front = std::move(mQueue.front());
-            mQueue.erase(mQueue.begin());
-            lock.unlock();
-            handleMessage(std::move(front));
-        }
-        else if(!mQueue.size() && !mQuit){
-                //this condition never occurs , added for coverity medium issue fix
-                lock.unlock();
-        }
+        auto ready = [this] {
+            return mQuit || isReady(std::chrono::steady_clock::now());
+        };
+        auto until = nextWakeup();
+        if (until != std::chrono::steady_clock::time_point::max())
+            mCondVar.wait_until(lock, until, ready);
+        else
+            mCondVar.wait(lock, ready);
+        if (mQuit)
+            break;
+        dispatchStep(lock);
     } while (!mQuit);
 }
 
+void MessageQueue::wake()
+{
+    if (mEngine == DISPATCH_ENGINE_THREAD)
+    {
+        mCondVar.notify_one();
+        return;
+    }
+    uint64_t one = 1;
+    if (write(mWakeFd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+        AppLogErrorEvery(1000) <<__func__<<": eventfd write failed: "<<strerror(errno)<<"\n";
+}
+
+// With the loop engine responses are handled on the main loop like
+// everything else, the nyx context only queues them.
+void MessageQueue::deliverResponse(ResponseBuffer resp)
+{
+    if (mEngine == DISPATCH_ENGINE_THREAD)
+    {
+        onResponse(std::move(resp));
+        return;
+    }
+    if (!mResponses.tryPush(resp))
+    {
+        AppLogWarningEvery(1000) <<__func__<<": Response queue full, handling inline\n";
+        onResponse(std::move(resp));
+        return;
+    }
+    wake();
+}
+
+gboolean MessageQueue::wakeCb(GIOChannel *channel, GIOCondition condition, gpointer data)
+{
+    MessageQueue *self = static_cast<MessageQueue*>(data);
+    uint64_t count;
+    while (read(self->mWakeFd, &count, sizeof(count)) > 0)
+        ;
+    self->runLoopStep();
+    return G_SOURCE_CONTINUE;
+}
+
+gboolean MessageQueue::timerCb(gpointer data)
+{
+    MessageQueue *self = static_cast<MessageQueue*>(data);
+    self->mTimer = 0;
+    self->runLoopStep();
+    return G_SOURCE_REMOVE;
+}
+
+// One main loop pass of the loop engine: takes in pending responses, sends
+// at most one frame so Luna traffic is not starved, then either asks for
+// another pass or arms a timer for the next timed work.
+void MessageQueue::runLoopStep()
+{
+    ResponseBuffer resp;
+    while (mResponses.pop(resp))
+        onResponse(std::move(resp));
+
+    std::unique_lock<std::mutex> lock(mMutex);
+    if (isReady(std::chrono::steady_clock::now()))
+        dispatchStep(lock);
+    else
+        lock.unlock();
+
+    lock.lock();
+    bool more = isReady(std::chrono::steady_clock::now());
+    auto until = nextWakeup();
+    lock.unlock();
+
+    if (mTimer)
+    {
+        g_source_remove(mTimer);
+        mTimer = 0;
+    }
+    if (more)
+    {
+        wake();
+    }
+    else if (until != std::chrono::steady_clock::time_point::max())
+    {
+        auto delay = std::chrono::duration_cast<std::chrono::milliseconds>(until - std::chrono::steady_clock::now());
+        mTimer = g_timeout_add(delay.count() > 0 ? static_cast<guint>(delay.count()) + 1 : 0, &MessageQueue::timerCb, this);
+    }
+}
+
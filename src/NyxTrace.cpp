@@ -0,0 +1,290 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include <cstring>
+
+#include "Logger.h"
+#include "NyxTrace.h"
+
+static const char TRACE_MAGIC[] = "CECTRACE";
+static const size_t TRACE_MAGIC_LEN = 8;
+static const uint16_t TRACE_VERSION = 1;
+
+NyxTraceMode NyxTrace::sMode = NYX_TRACE_OFF;
+std::string NyxTrace::sPath;
+
+void NyxTrace::configure(NyxTraceMode mode, const std::string &path)
+{
+    sMode = mode;
+    sPath = path;
+}
+
+static void putU16(std::string &buf, uint16_t value)
+{
+    buf.push_back(static_cast<char>(value & 0xFF));
+    buf.push_back(static_cast<char>((value >> 8) & 0xFF));
+}
+
+static void putU32(std::string &buf, uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+        buf.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+}
+
+static void putU64(std::string &buf, uint64_t value)
+{
+    for (int i = 0; i < 8; i++)
+        buf.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+}
+
+static void putString(std::string &buf, const char *str)
+{
+    size_t len = strlen(str);
+    if (len > UINT16_MAX)
+        len = UINT16_MAX;
+    putU16(buf, static_cast<uint16_t>(len));
+    buf.append(str, len);
+}
+
+static bool getU16(const std::string &buf, size_t &pos, uint16_t &value)
+{
+    if (pos + 2 > buf.size())
+        return false;
+    value = static_cast<uint8_t>(buf[pos]) | (static_cast<uint8_t>(buf[pos + 1]) << 8);
+    pos += 2;
+    return true;
+}
+
+static bool getString(const std::string &buf, size_t &pos, std::string &str)
+{
+    uint16_t len = 0;
+    if (!getU16(buf, pos, len) || pos + len > buf.size())
+        return false;
+    str.assign(buf, pos, len);
+    pos += len;
+    return true;
+}
+
+static bool readU64(FILE *file, uint64_t &value, size_t bytes)
+{
+    unsigned char raw[8];
+    if (fread(raw, 1, bytes, file) != bytes)
+        return false;
+    value = 0;
+    for (size_t i = 0; i < bytes; i++)
+        value |= static_cast<uint64_t>(raw[i]) << (8 * i);
+    return true;
+}
+
+NyxTraceRecorder::NyxTraceRecorder(const std::string &path)
+    : mFile(nullptr), mStart(std::chrono::steady_clock::now())
+{
+    // Each start records a trace of its own, timestamps restart at zero.
+    mFile = fopen(path.c_str(), "wb");
+    if (!mFile) {
+        AppLogError() << "Failed to open nyx trace file: " << path;
+        return;
+    }
+
+    std::string header(TRACE_MAGIC, TRACE_MAGIC_LEN);
+    putU16(header, TRACE_VERSION);
+    fwrite(header.data(), 1, header.size(), mFile);
+    fflush(mFile);
+    AppLogInfo() << "Recording nyx traffic to " << path;
+}
+
+NyxTraceRecorder::~NyxTraceRecorder()
+{
+    if (mFile)
+        fclose(mFile);
+}
+
+void NyxTraceRecorder::recordCommand(const nyx_cec_command_t &command)
+{
+    std::string body;
+    putString(body, command.name);
+    putU16(body, static_cast<uint16_t>(command.size));
+    for (int i = 0; i < command.size; i++) {
+        putString(body, command.params[i].name);
+        putString(body, command.params[i].value);
+    }
+    writeRecord(NYX_TRACE_COMMAND, body);
+}
+
+void NyxTraceRecorder::recordResponse(const ResponseBuffer &resp)
+{
+    std::string body;
+    putU16(body, static_cast<uint16_t>(resp.size()));
+    for (const auto &line : resp)
+        putString(body, line.c_str());
+    writeRecord(NYX_TRACE_RESPONSE, body);
+}
+
+void NyxTraceRecorder::writeRecord(NyxTraceRecordKind kind, const std::string &body)
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    if (!mFile)
+        return;
+
+    uint64_t timestamp = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - mStart).count();
+
+    std::string record;
+    record.reserve(13 + body.size());
+    record.push_back(static_cast<char>(kind));
+    putU64(record, timestamp);
+    putU32(record, static_cast<uint32_t>(body.size()));
+    record.append(body);
+
+    fwrite(record.data(), 1, record.size(), mFile);
+    fflush(mFile);
+}
+
+NyxTracePlayer::NyxTracePlayer(const std::string &path, bool realTime, NyxReplayCallback cb)
+    : mRealTime(realTime), mCb(std::move(cb))
+{
+    mLoaded = load(path);
+    if (!mLoaded) {
+        AppLogError() << "Failed to load nyx trace file: " << path;
+        return;
+    }
+    AppLogInfo() << "Replaying nyx traffic from " << path << " (" << mRecords.size() << " records)";
+    mThread = std::thread(std::bind(&NyxTracePlayer::deliverLoop, this));
+}
+
+NyxTracePlayer::~NyxTracePlayer()
+{
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mQuit = true;
+    }
+    mCondVar.notify_one();
+    if (mThread.joinable())
+        mThread.join();
+}
+
+bool NyxTracePlayer::load(const std::string &path)
+{
+    FILE *file = fopen(path.c_str(), "rb");
+    if (!file)
+        return false;
+
+    char magic[TRACE_MAGIC_LEN];
+    uint64_t version = 0;
+    if (fread(magic, 1, TRACE_MAGIC_LEN, file) != TRACE_MAGIC_LEN || memcmp(magic, TRACE_MAGIC, TRACE_MAGIC_LEN) != 0
+            || !readU64(file, version, 2) || version != TRACE_VERSION) {
+        fclose(file);
+        return false;
+    }
+
+    for (;;) {
+        int kind = fgetc(file);
+        if (kind == EOF)
+            break;
+
+        uint64_t timestamp = 0;
+        uint64_t length = 0;
+        if (!readU64(file, timestamp, 8) || !readU64(file, length, 4))
+            break;
+
+        std::string body(length, '\0');
+        if (length && fread(&body[0], 1, length, file) != length)
+            break;
+
+        Record record;
+        record.kind = static_cast<NyxTraceRecordKind>(kind);
+        record.timestamp = timestamp;
+
+        size_t pos = 0;
+        uint16_t count = 0;
+        if (record.kind == NYX_TRACE_COMMAND) {
+            if (!getString(body, pos, record.name))
+                break;
+        } else if (record.kind == NYX_TRACE_RESPONSE) {
+            if (!getU16(body, pos, count))
+                break;
+            for (uint16_t i = 0; i < count; i++) {
+                std::string line;
+                if (!getString(body, pos, line))
+                    break;
+                record.lines.push_back(std::move(line));
+            }
+        } else {
+            AppLogWarning() << "Skipping unknown nyx trace record kind " << kind;
+            continue;
+        }
+        mRecords.push_back(std::move(record));
+    }
+
+    fclose(file);
+    return true;
+}
+
+void NyxTracePlayer::replayCommand(const nyx_cec_command_t &command)
+{
+    auto now = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(mMutex);
+
+    while (mCursor < mRecords.size() && mRecords[mCursor].kind != NYX_TRACE_COMMAND)
+        mCursor++;
+
+    if (mCursor >= mRecords.size()) {
+        AppLogWarning() << "Nyx trace exhausted, dropping command: " << command.name;
+        return;
+    }
+
+    const Record &cmd = mRecords[mCursor++];
+    if (cmd.name != command.name)
+        AppLogWarning() << "Nyx trace diverged, expected: " << cmd.name << " got: " << command.name;
+
+    for (; mCursor < mRecords.size() && mRecords[mCursor].kind == NYX_TRACE_RESPONSE; mCursor++) {
+        Pending pending;
+        pending.due = now;
+        if (mRealTime)
+            pending.due += std::chrono::microseconds(mRecords[mCursor].timestamp - cmd.timestamp);
+        pending.response = ResponseBuffer(mRecords[mCursor].lines);
+
+        auto it = mPending.begin();
+        while (it != mPending.end() && it->due <= pending.due)
+            ++it;
+        mPending.insert(it, std::move(pending));
+    }
+    lock.unlock();
+    mCondVar.notify_one();
+}
+
+void NyxTracePlayer::deliverLoop()
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (!mQuit) {
+        if (mPending.empty()) {
+            mCondVar.wait(lock);
+            continue;
+        }
+
+        auto due = mPending.front().due;
+        if (std::chrono::steady_clock::now() < due) {
+            mCondVar.wait_until(lock, due);
+            continue;
+        }
+
+        ResponseBuffer response = std::move(mPending.front().response);
+        mPending.pop_front();
+        lock.unlock();
+        mCb(std::move(response));
+        lock.lock();
+    }
+}
@@ -0,0 +1,77 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+#include <cstring>
+
+#include "ResponseBuffer.h"
+
+template <typename GetLine>
+void ResponseBuffer::build(size_t count, GetLine getLine)
+{
+    size_t header = (count + 1) * sizeof(uint32_t);
+    size_t total = header;
+    for (size_t i = 0; i < count; i++)
+        total += getLine(i).size() + 1;
+
+    mBlock.reset(new char[total]);
+    mLines = count;
+    uint32_t *lineOffsets = offsets();
+    size_t pos = header;
+    for (size_t i = 0; i < count; i++)
+    {
+        LineView text = getLine(i);
+        lineOffsets[i] = static_cast<uint32_t>(pos);
+        memcpy(mBlock.get() + pos, text.c_str(), text.size());
+        mBlock[pos + text.size()] = '\0';
+        pos += text.size() + 1;
+    }
+    lineOffsets[count] = static_cast<uint32_t>(pos);
+}
+
+ResponseBuffer::ResponseBuffer(const nyx_cec_response_t &response)
+{
+    size_t count = response.size < 0 ? 0 : static_cast<size_t>(response.size);
+    size_t capacity = sizeof(response.responses) / sizeof(response.responses[0]);
+    if (count > capacity)
+        count = capacity;
+    build(count, [&response](size_t i) {
+        return LineView(response.responses[i], strnlen(response.responses[i], sizeof(response.responses[i])));
+    });
+}
+
+ResponseBuffer::ResponseBuffer(const std::vector<std::string> &lines)
+{
+    build(lines.size(), [&lines](size_t i) {
+        return LineView(lines[i]);
+    });
+}
+
+ResponseBuffer::ResponseBuffer(const char *line)
+{
+    LineView text(line, strlen(line));
+    build(1, [&text](size_t) {
+        return text;
+    });
+}
+
+LineView ResponseBuffer::line(size_t index) const
+{
+    if (index >= mLines)
+        return LineView();
+    const uint32_t *lineOffsets = offsets();
+    return LineView(mBlock.get() + lineOffsets[index], lineOffsets[index + 1] - lineOffsets[index] - 1);
+}
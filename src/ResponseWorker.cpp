@@ -0,0 +1,119 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+#include "Logger.h"
+#include "ResponseWorker.h"
+
+ResponseWorker::ResponseWorker()
+    : mOverflowing(false), mPending(0), mRunning(false)
+{
+}
+
+ResponseWorker::~ResponseWorker()
+{
+    stop();
+}
+
+void ResponseWorker::setHandler(ResponseHandler handler)
+{
+    mHandler = std::move(handler);
+}
+
+void ResponseWorker::start()
+{
+    if (mRunning)
+        return;
+    mRunning = true;
+    mThread = std::thread(&ResponseWorker::run, this);
+}
+
+void ResponseWorker::stop()
+{
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mRunning = false;
+    }
+    mCondVar.notify_one();
+    if (mThread.joinable())
+        mThread.join();
+}
+
+void ResponseWorker::post(std::shared_ptr<MessageData> request, ResponseBuffer response)
+{
+    if (!mRunning)
+    {
+        mHandler(std::move(request), std::move(response));
+        return;
+    }
+
+    Job job;
+    job.request = std::move(request);
+    job.response = std::move(response);
+    if (mOverflowing || !mJobs.tryPush(job))
+    {
+        // Handling it here would overtake responses still queued
+        std::unique_lock<std::mutex> lock(mMutex);
+        if (mOverflowing || !mJobs.tryPush(job))
+        {
+            AppLogWarningEvery(1000) <<__func__<<": Response worker backlog full\n";
+            mOverflow.push_back(std::move(job));
+            mOverflowing = true;
+        }
+    }
+
+    mPending.fetch_add(1);
+    {
+        // Pairs with the predicate check so the wakeup is not lost
+        std::unique_lock<std::mutex> lock(mMutex);
+    }
+    mCondVar.notify_one();
+}
+
+void ResponseWorker::run()
+{
+    Job job;
+    std::deque<Job> overflow;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mCondVar.wait(lock, [this] { return !mRunning || mPending.load() > 0; });
+            if (!mRunning)
+                return;
+        }
+
+        while (mJobs.pop(job))
+        {
+            mPending.fetch_sub(1);
+            mHandler(std::move(job.request), std::move(job.response));
+        }
+
+        // Everything in the overflow list was posted after what was just
+        // handled, and goes before anything posted once it is taken
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            overflow.swap(mOverflow);
+            mOverflowing = false;
+        }
+        for (auto &queued : overflow)
+        {
+            mPending.fetch_sub(1);
+            mHandler(std::move(queued.request), std::move(queued.response));
+        }
+        overflow.clear();
+    }
+}
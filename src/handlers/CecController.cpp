@@ -36,7 +36,7 @@ CecController::~CecController() {
 }
 
 bool CecController::initialize() {
-  AppLogInfo()<<" CecController::"<<__func__<<":"<<__LINE__;
+  AppLogDebug()<<" CecController::"<<__func__<<":"<<__LINE__;
   if (mInitlialized)
     return true;
 
@@ -50,13 +50,17 @@ bool CecController::initialize() {
   return true;
 }
 
-bool CecController::HandleCommand(std::shared_ptr<Command> command) {
-  AppLogInfo()<<" CecController::"<<__func__<<":"<<__LINE__;
-
+void CecController::WaitForInitialization() {
   if(!mInitlialized) {
     bool ret = m_InitFut.get();
-    AppLogInfo()<<" HandleCommand:: async call done with return "<<ret<<"\n";
+    AppLogInfo()<<" CecController:: async call done with return "<<ret<<"\n";
   }
+}
+
+bool CecController::HandleCommand(std::shared_ptr<Command> command) {
+  AppLogDebug()<<" CecController::"<<__func__<<":"<<__LINE__;
+
+  WaitForInitialization();
 
   for (auto it = mHandlerList.begin(); it!=mHandlerList.end(); ++it) {
     AppLogDebug()<<"CecController::"<<__func__<<":"<<__LINE__<<" Calling registered handlers";
@@ -67,7 +71,7 @@ bool CecController::HandleCommand(std::shared_ptr<Command> command) {
 }
 
 bool CecController::Register(CreateCecHandlerObject createObject, HandlerRank rank) {
-  AppLogInfo()<<" CecController::"<<__func__<<":"<<__LINE__<<" Rank:"<<rank;
+  AppLogDebug()<<" CecController::"<<__func__<<":"<<__LINE__<<" Rank:"<<rank;
   std::pair<CreateCecHandlerObject,HandlerRank> creator;
 
   creator.first = createObject;
@@ -91,7 +95,51 @@ bool CecController::Register(CreateCecHandlerObject createObject, HandlerRank ra
   return true;
 }
 
+HandlerErrorCode CecController::SendKey(const SendKeyReqData &keyData) {
+  WaitForInitialization();
+
+  for (auto it = mHandlerList.begin(); it!=mHandlerList.end(); ++it) {
+    HandlerErrorCode ret = (*it)->SendKey(keyData);
+    if (ret != HANDLER_ERROR_INVALID_COMMAND)
+      return ret;
+  }
+  return HANDLER_ERROR_INVALID_COMMAND;
+}
+
+HandlerErrorCode CecController::GetBusStatus(std::vector<BusStatus> &status) {
+  WaitForInitialization();
+
+  for (auto it = mHandlerList.begin(); it!=mHandlerList.end(); ++it) {
+    HandlerErrorCode ret = (*it)->GetBusStatus(status);
+    if (ret != HANDLER_ERROR_INVALID_COMMAND)
+      return ret;
+  }
+  return HANDLER_ERROR_INVALID_COMMAND;
+}
+
+HandlerErrorCode CecController::GetTopology(const std::string &adapter, CecTopology &topology) {
+  WaitForInitialization();
+
+  for (auto it = mHandlerList.begin(); it!=mHandlerList.end(); ++it) {
+    HandlerErrorCode ret = (*it)->GetTopology(adapter, topology);
+    if (ret != HANDLER_ERROR_INVALID_COMMAND)
+      return ret;
+  }
+  return HANDLER_ERROR_INVALID_COMMAND;
+}
+
 std::shared_ptr<CecDevice> CecController::GetDeviceInfo(std::string destAddress) {
   CecHandler *default_handler = mHandlerList.back();
   return default_handler->GetDeviceInfo(std::move(destAddress));
 }
+
+void CecController::AddEventListener(CecEventListener listener) {
+  mEventListeners.push_back(std::move(listener));
+}
+
+void CecController::NotifyEvent(const std::string &adapter, const CecFrame &frame) {
+  AppLogDebug()<<" CecController::"<<__func__<<":"<<__LINE__<<" event: "<<cecOpcodeName(frame.opcode)<<" on: "<<adapter;
+  for (auto it = mEventListeners.begin(); it!=mEventListeners.end(); ++it) {
+    (*it)(adapter, frame);
+  }
+}
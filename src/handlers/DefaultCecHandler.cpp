@@ -14,60 +14,247 @@
 //
 // SPDX-License-Identifier: Apache-2.0
 
+#include <algorithm>
 #include <cstring>
+#include <cstdlib>
+#include "CecErrors.h"
 #include "DefaultCecHandler.h"
+#include "ObjectPool.h"
 
 bool DefaultCecHandler::mIsObjRegistered = DefaultCecHandler::RegisterObject();
 
-std::list<std::shared_ptr<Command>> DefaultCecHandler::mCmdList;
 std::mutex DefaultCecHandler::mMutex;
 std::list<CecDevice> DefaultCecHandler::mDeviceInfoList;
 std::list<std::string> DefaultCecHandler::mAdaptersList;
+std::map<std::string, CecTopology> DefaultCecHandler::mTopologies;
+std::mutex DefaultCecHandler::mReplyWaitsMutex;
+std::list<std::shared_ptr<ReplyWait>> DefaultCecHandler::mReplyWaits;
 
-static void printResp(std::vector<std::string> resp) {
+static void printResp(const ResponseBuffer &resp) {
+  if (!appLogEnabled(APP_LOG_LEVEL_DEBUG))
+    return;
   for (auto it=resp.begin(); it!=resp.end(); ++it) {
     AppLogDebug()<<*it;
   }
 }
 
 DefaultCecHandler::DefaultCecHandler() :
-                       CecHandler() {
+                       CecHandler(), mRefresher([this](bool full) { RefreshTopology(full); }) {
 
-  mQueue.setCallback(DefaultCecHandler::HandleMessageCb);
+  mQueue.setCallback([this](std::shared_ptr<MessageData> msgData, ResponseBuffer resp) {
+    HandleResponse(std::move(msgData), std::move(resp));
+  });
+  mQueue.setEventCallback([this](const std::string &adapter, const CecFrame &frame) {
+    HandleEventCb(adapter, frame);
+    TrackTopologyEvent(frame);
+  });
 
+  // The device table is filled in the background once the adapters are known
   std::shared_ptr<Command> listAdapterCommand = std::make_shared<Command>(CommandType::LIST_ADAPTERS,
-                                                                          [](std::shared_ptr<CommandResData> resp) -> void {});
+                                                                          [this](std::shared_ptr<CommandResData> resp) -> void {
+                                                                            if (resp->returnValue)
+                                                                              mRefresher.Start();
+                                                                          });
 
-  {
-    std::unique_lock<std::mutex> lock(mMutex);
-    mCmdList.push_back(listAdapterCommand);
-  }
-
-  std::shared_ptr<MessageData> msgDataAdapter = std::make_shared<MessageData>();
+  std::shared_ptr<MessageData> msgDataAdapter = makePooled<MessageData>();
   msgDataAdapter->type = LIST_ADAPTERS;
+  msgDataAdapter->priority = PRIORITY_BACKGROUND;
+  msgDataAdapter->command = std::move(listAdapterCommand);
   mQueue.addMessage(std::move(msgDataAdapter));
 }
 
 DefaultCecHandler::~DefaultCecHandler() {
 }
 
-void DefaultCecHandler::HandleMessageCb(CommandType type, std::vector<std::string> resp) {
-  AppLogInfo()<<" DefaultCecHandler::"<<__func__<<":"<<__LINE__;
-  switch(type) {
+struct RetryContext {
+  DefaultCecHandler *handler;
+  std::shared_ptr<MessageData> msgData;
+};
+
+// A request the device acknowledged but did not answer yet, it counts as
+// unhandled only if the reply does not come within the request timeout
+struct ReplyWait {
+  std::string adapter;
+  CecFrame frame;
+  uint8_t expected;
+  std::string vendor;
+  uint16_t physical;
+  bool answered;
+};
+
+struct DiscoveryContext {
+  DefaultCecHandler *handler;
+  std::shared_ptr<Command> command;
+};
+
+struct RefreshContext {
+  std::mutex mutex;
+  size_t pending = 0;
+  bool changed = false;
+};
+
+// Results of an all adapters scan, answered once every adapter reported
+// or SCAN_TIMEOUT_MS passed. Filled from the response workers of several
+// engines.
+struct ScanAllContext {
+  std::mutex mutex;
+  std::shared_ptr<Command> command;
+  size_t pending = 0;
+  bool answered = false;
+  // Per adapter, in adapter list order
+  std::vector<std::shared_ptr<ScanResData>> results;
+};
+
+// Device fields an incremental scan asks for when they are missing
+enum ScanField {
+  SCAN_FIELD_ADDRESS = 1 << 0,
+  SCAN_FIELD_VENDOR = 1 << 1,
+  SCAN_FIELD_OSD = 1 << 2
+};
+
+struct IncrementalScan {
+  std::mutex mutex;
+  // Command the probes run for, they stop when it is cancelled
+  std::shared_ptr<Command> command;
+  // Called with the devices found and whether any came or went
+  std::function<void(std::shared_ptr<ScanResData>, bool)> done;
+  std::string adapter;
+  MessagePriority priority;
+  size_t pending = 0;
+  std::list<CecDevice> found;
+  // Logical addresses that did not acknowledge the poll
+  std::vector<uint8_t> gone;
+};
+
+// One logical address of an incremental scan
+struct ScanProbe {
+  std::shared_ptr<IncrementalScan> scan;
+  uint8_t address;
+  CecDevice device;
+  // True once the device is known to be present
+  bool answered;
+  // ScanField bits already asked for
+  int asked;
+  // True when the device was already in the table before the scan
+  bool known;
+};
+
+// Logical address a destination given as a bare number stands for, or -1
+static int ParseLogicalAddress(const std::string &destAddress) {
+  if (destAddress.empty() || destAddress.find_first_not_of("0123456789") != std::string::npos)
+    return -1;
+  long address = std::strtol(destAddress.c_str(), nullptr, 10);
+  return address < CEC_BROADCAST_ADDRESS ? static_cast<int>(address) : -1;
+}
+
+// Whether the device is the one a client named by destAddress on adapter.
+// Devices are listed by physical address once it is known, so a logical
+// address also matches the device holding it on that adapter.
+static bool MatchesDestination(const CecDevice &device, const std::string &adapter, const std::string &destAddress) {
+  if (device.getAddress() == destAddress)
+    return true;
+  int logicalAddress = ParseLogicalAddress(destAddress);
+  if (logicalAddress < 0 || device.getLogicalAddress() != logicalAddress)
+    return false;
+  return device.getAdapter() == (adapter.empty() ? DEFAULT_CEC_ADAPTER : adapter);
+}
+
+static const std::string& MessageAdapter(const MessageData &msgData) {
+  const std::string *adapter = msgData.params.get(PARAM_ADAPTER);
+  return adapter ? *adapter : msgData.adapter;
+}
+
+bool DefaultCecHandler::IsFailedResponse(const ResponseBuffer &resp) {
+  for (auto it=resp.begin(); it!=resp.end(); ++it) {
+    if ((*it).find("response") != std::string::npos)
+      return GetValue(*it) == "failed";
+  }
+  return false;
+}
+
+void DefaultCecHandler::HandleResponse(std::shared_ptr<MessageData> msgData, ResponseBuffer resp) {
+  if (resp.size() == 1 && resp.front() == RESPONSE_DEADLINE_EXCEEDED) {
+    ErrorInfo errInfo{CEC_ERR_DEADLINE_EXCEEDED, retrieveErrorText(CEC_ERR_DEADLINE_EXCEEDED)};
+    for (auto it = msgData->waiters.begin(); it != msgData->waiters.end(); ++it)
+      RespondWithError(*it, errInfo);
+    if (msgData->command)
+      RespondWithError(msgData->command, errInfo);
+    return;
+  }
+
+  if (IsFailedResponse(resp)) {
+    if (!msgData->probe)
+      mRetry.RecordFailure(MessageAdapter(*msgData), msgData->destination);
+    if (ScheduleRetry(msgData))
+      return;
+  } else {
+    mRetry.RecordSuccess(MessageAdapter(*msgData), msgData->destination);
+  }
+  HandleMessageCb(std::move(msgData), resp);
+}
+
+bool DefaultCecHandler::ScheduleRetry(std::shared_ptr<MessageData> msgData) {
+  if (msgData->isCancelled() || msgData->attempts >= RetryPolicy::GetBudget(msgData->type)
+      || !mRetry.AllowSend(MessageAdapter(*msgData), msgData->destination))
+    return false;
+
+  std::chrono::milliseconds delay = mRetry.GetBackoff(msgData->attempts + 1);
+  // Not worth a retry if the answer would come too late anyway
+  if (std::chrono::steady_clock::now() + delay > msgData->deadline)
+    return false;
+
+  msgData->attempts++;
+  AppLogInfo()<<" DefaultCecHandler::"<<__func__<<":"<<__LINE__<<" retry "<<msgData->attempts
+              <<" in "<<delay.count()<<"ms";
+  RetryContext *ctx = new RetryContext{this, std::move(msgData)};
+  g_timeout_add(static_cast<guint>(delay.count()), &DefaultCecHandler::RetryTimeoutCb, ctx);
+  return true;
+}
+
+gboolean DefaultCecHandler::RetryTimeoutCb(gpointer data) {
+  std::unique_ptr<RetryContext> ctx(static_cast<RetryContext*>(data));
+  MessageQueue &queue = ctx->handler->GetQueue(*ctx->msgData);
+  queue.addMessage(std::move(ctx->msgData));
+  return G_SOURCE_REMOVE;
+}
+
+void DefaultCecHandler::HandleMessageCb(std::shared_ptr<MessageData> msgData, const ResponseBuffer &resp) {
+  AppLogDebug()<<" DefaultCecHandler::"<<__func__<<":"<<__LINE__;
+  if (!msgData->command) {
+    AppLogError()<<" DefaultCecHandler::"<<__func__<<":"<<__LINE__<<" Response without a command";
+    return;
+  }
+
+  // Commands coalesced into this message share its response
+  for (auto it = msgData->waiters.begin(); it != msgData->waiters.end(); ++it)
+    HandleCommandCb(*msgData, *it, resp);
+  HandleCommandCb(*msgData, msgData->command, resp);
+}
+
+void DefaultCecHandler::HandleCommandCb(const MessageData &msgData, std::shared_ptr<Command> command, const ResponseBuffer &resp) {
+  if (command->isCancelled()) {
+    AppLogDebug()<<" DefaultCecHandler::"<<__func__<<":"<<__LINE__<<" Dropping reply for cancelled command";
+    return;
+  }
+
+  switch(msgData.type) {
     case SEND_COMMAND:
-      return HandleSendCommandCb(resp);
+      return HandleSendCommandCb(std::move(command), resp);
 
     case LIST_ADAPTERS:
-      return HandleListAdaptersCb(resp);
+      return HandleListAdaptersCb(std::move(command), resp);
 
     case SCAN:
-      return HandleScanCb(resp);
+      return HandleScanCb(std::move(command), resp);
 
     case GET_CONFIG:
-      return HandleGetConfigCb(resp);
+      return HandleGetConfigCb(std::move(command), resp);
 
     case SET_CONFIG:
-      return HandleSetConfigCb(std::move(resp));
+      return HandleSetConfigCb(std::move(command), resp);
+
+    case SEND_FRAME:
+      return HandleSendFrameCb(std::move(command), resp, msgData.probe);
 
     default:
       AppLogError()<<" DefaultCecHandler::"<<__func__<<":"<<__LINE__<<" Invalid command type";
@@ -75,7 +262,129 @@ void DefaultCecHandler::HandleMessageCb(CommandType type, std::vector<std::strin
   }
 }
 
-std::string DefaultCecHandler::GetValue(std::string str) {
+void DefaultCecHandler::HandleEventCb(const std::string &adapter, const CecFrame &frame) {
+  AppLogDebug()<<" DefaultCecHandler::"<<__func__<<":"<<__LINE__<<" event: "<<cecOpcodeName(frame.opcode)<<" from: "<<(int)frame.initiator
+               <<" on: "<<adapter;
+  if (!frame.hasOpcode)
+    return;
+
+  MatchReplyWaits(adapter, frame);
+  UpdateDeviceInfo(adapter, frame);
+  CecController::getInstance()->NotifyEvent(adapter, frame);
+}
+
+// Logical addresses are per adapter, devices are found by both
+void DefaultCecHandler::UpdateDeviceInfo(const std::string &adapter, const CecFrame &frame) {
+  std::unique_lock<std::mutex> lock(mMutex);
+  auto device = mDeviceInfoList.begin();
+  for (; device != mDeviceInfoList.end(); ++device) {
+    if ((*device).getAdapter() == adapter && (*device).getLogicalAddress() == frame.initiator)
+      break;
+  }
+  if (device != mDeviceInfoList.end())
+    (*device).touch();
+
+  switch (frame.opcode) {
+    case CEC_OPCODE_REPORT_PHYSICAL_ADDRESS: {
+      if (frame.length < 2)
+        return;
+      std::string address = cecPhysicalAddressString(frame.operands[0], frame.operands[1]);
+      // A device new at the address may not handle what the last one did
+      uint16_t physical = static_cast<uint16_t>((frame.operands[0] << 8) | frame.operands[1]);
+      if (device == mDeviceInfoList.end() || (*device).getPhysicalAddress() != physical) {
+        if (device != mDeviceInfoList.end())
+          CapabilityCache::instance().expire((*device).getPhysicalAddress());
+        CapabilityCache::instance().expire(physical);
+      }
+      if (device == mDeviceInfoList.end()) {
+        CecDevice dev {cecLogicalAddressName(frame.initiator), address, "no", "", "", "", "", ""};
+        dev.setLogicalAddress(frame.initiator);
+        dev.setAdapter(adapter);
+        dev.touch();
+        mDeviceInfoList.push_back(dev);
+      } else {
+        (*device).setAddress(std::move(address));
+      }
+      RebuildTopology();
+      return;
+    }
+
+    case CEC_OPCODE_FEATURE_ABORT:
+      if (frame.isBroadcast() || frame.length < 1 || device == mDeviceInfoList.end()
+          || (*device).getPhysicalAddress() == CEC_INVALID_PHYSICAL_ADDRESS)
+        return;
+      CapabilityCache::instance().recordAbort((*device).getVendor(), (*device).getPhysicalAddress(),
+                                              frame.operands[0], frame.length >= 2 ? frame.operands[1] : 0);
+      return;
+
+    case CEC_OPCODE_ACTIVE_SOURCE:
+      for (auto it = mDeviceInfoList.begin(); it != mDeviceInfoList.end(); ++it) {
+        if ((*it).getAdapter() == adapter)
+          (*it).setActiveSource(it == device ? "yes" : "no");
+      }
+      return;
+
+    case CEC_OPCODE_STANDBY:
+      if (frame.isBroadcast()) {
+        for (auto it = mDeviceInfoList.begin(); it != mDeviceInfoList.end(); ++it) {
+          if ((*it).getAdapter() == adapter)
+            (*it).setPowerStatus(cecPowerStatusString(0x01));
+        }
+        return;
+      }
+      break;
+
+    default:
+      break;
+  }
+
+  if (device == mDeviceInfoList.end())
+    return;
+
+  ApplyDeviceFrame(*device, frame);
+}
+
+// Updates the device from a frame it sent
+void DefaultCecHandler::ApplyDeviceFrame(CecDevice &device, const CecFrame &frame) {
+  switch (frame.opcode) {
+    case CEC_OPCODE_STANDBY:
+      device.setPowerStatus(cecPowerStatusString(0x01));
+      break;
+
+    case CEC_OPCODE_INACTIVE_SOURCE:
+      device.setActiveSource("no");
+      break;
+
+    case CEC_OPCODE_REPORT_PHYSICAL_ADDRESS:
+      if (frame.length >= 2)
+        device.setAddress(cecPhysicalAddressString(frame.operands[0], frame.operands[1]));
+      break;
+
+    case CEC_OPCODE_REPORT_POWER_STATUS:
+      if (frame.length >= 1)
+        device.setPowerStatus(cecPowerStatusString(frame.operands[0]));
+      break;
+
+    case CEC_OPCODE_DEVICE_VENDOR_ID:
+      if (frame.length >= 3)
+        device.setVendor(cecVendorString((frame.operands[0] << 16) | (frame.operands[1] << 8) | frame.operands[2]));
+      break;
+
+    case CEC_OPCODE_SET_OSD_NAME:
+      device.setOsd(std::string(reinterpret_cast<const char*>(frame.operands), frame.length));
+      break;
+
+    case CEC_OPCODE_CEC_VERSION:
+      if (frame.length >= 1)
+        device.setCecVersion(cecVersionString(frame.operands[0]));
+      break;
+
+    default:
+      break;
+  }
+}
+
+std::string DefaultCecHandler::GetValue(const LineView &str) {
   std::size_t pos = str.find_first_of(':');
   if (pos == std::string::npos  || pos == str.size())
     return "";
@@ -85,8 +394,8 @@ std::string DefaultCecHandler::GetValue(std::string str) {
   return str.substr(actualPos);
 }
 
-void DefaultCecHandler::HandleSystemInfoResp(std::shared_ptr<SendCommandReqData> commandData, std::vector<std::string> resp, std::shared_ptr<SendCommandResData> respCmd) {
-  AppLogInfo()<<" DefaultCecHandler::"<<__func__<<":"<<__LINE__;
+void DefaultCecHandler::HandleSystemInfoResp(std::shared_ptr<SendCommandReqData> commandData, const ResponseBuffer &resp, std::shared_ptr<SendCommandResData> respCmd) {
+  AppLogDebug()<<" DefaultCecHandler::"<<__func__<<":"<<__LINE__;
   for (auto it = commandData->command.args.begin();  it!=commandData->command.args.end(); ++it) {
     SendCommandPayload payload;
     payload.key = (*it).arg;
@@ -148,22 +457,13 @@ void DefaultCecHandler::HandleSystemInfoResp(std::shared_ptr<SendCommandReqData>
   }
 }
 
-void DefaultCecHandler::HandleSendCommandCb(std::vector<std::string> resp) {
-  AppLogInfo()<<" DefaultCecHandler::"<<__func__<<":"<<__LINE__;
+void DefaultCecHandler::HandleSendCommandCb(std::shared_ptr<Command> command, const ResponseBuffer &resp) {
+  AppLogDebug()<<" DefaultCecHandler::"<<__func__<<":"<<__LINE__;
   AppLogDebug()<<"SEND_COMMAND Response : START";
   printResp(resp);
   AppLogDebug()<<"SEND_COMMAND Response : END";
 
-  std::shared_ptr<Command> command;
-  {
-    std::unique_lock<std::mutex> lock(mMutex);
-    command = mCmdList.front();
-    if (command->getType() != SEND_COMMAND)
-      return;
-    mCmdList.pop_front();
-  }
-
-  std::shared_ptr<SendCommandResData> respCmd = std::make_shared<SendCommandResData>();
+  std::shared_ptr<SendCommandResData> respCmd = makePooled<SendCommandResData>();
   CommandCallback callback = command->getCallback();
   respCmd->returnValue = true;
 
@@ -320,22 +620,14 @@ void DefaultCecHandler::HandleSendCommandCb(std::vector<std::string> resp) {
   }
 }
 
-void DefaultCecHandler::HandleScanCb(std::vector<std::string> resp) {
-  AppLogInfo()<<" DefaultCecHandler::"<<__func__<<":"<<__LINE__;
+void DefaultCecHandler::HandleScanCb(std::shared_ptr<Command> command, const ResponseBuffer &resp) {
+  AppLogDebug()<<" DefaultCecHandler::"<<__func__<<":"<<__LINE__;
   AppLogDebug()<<"SCAN_COMMAND Response : START";
   printResp(resp);
   AppLogDebug()<<"SCAN_COMMAND Response : END";
 
-  std::shared_ptr<Command> command;
-  {
-    std::unique_lock<std::mutex> lock(mMutex);
-    command = mCmdList.front();
-    if (command->getType() != SCAN)
-      return;
-    mCmdList.pop_front();
-  }
-
-  std::shared_ptr<ScanResData> respCmd = std::make_shared<ScanResData>();
+  std::shared_ptr<ScanReqData> scanData = std::static_pointer_cast<ScanReqData>(command->getData());
+  std::shared_ptr<ScanResData> respCmd = makePooled<ScanResData>();
   CommandCallback callback = command->getCallback();
   respCmd->returnValue = true;
 
@@ -352,6 +644,10 @@ void DefaultCecHandler::HandleScanCb(std::vector<std::string> resp) {
     }
 
     std::string name = GetValue(*it);
+    int logicalAddress = -1;
+    std::size_t hashPos = (*it).find('#');
+    if (hashPos != std::string::npos)
+      logicalAddress = std::strtol((*it).c_str() + hashPos + 1, nullptr, 10);
     ++it;
 
     std::string address;
@@ -405,6 +701,10 @@ void DefaultCecHandler::HandleScanCb(std::vector<std::string> resp) {
                   std::move(cecVersion),
                   std::move(powerStatus),
                   std::move(language)};
+    dev.setLogicalAddress(logicalAddress);
+    if (!scanData->adapter.empty())
+      dev.setAdapter(scanData->adapter);
+    dev.touch();
 
     respCmd->devices.push_back(dev);
 
@@ -412,7 +712,7 @@ void DefaultCecHandler::HandleScanCb(std::vector<std::string> resp) {
       std::unique_lock<std::mutex> lock(mMutex);
       for (auto itr = mDeviceInfoList.begin(); itr != mDeviceInfoList.end(); ++itr)
       {
-        if ((*itr).getAddress() == address)
+        if ((*itr).getAddress() == address && (*itr).getAdapter() == dev.getAdapter())
         {
           mDeviceInfoList.erase(itr);
           break;
@@ -422,25 +722,20 @@ void DefaultCecHandler::HandleScanCb(std::vector<std::string> resp) {
     }
   }
 
+  {
+    std::unique_lock<std::mutex> lock(mMutex);
+    RebuildTopology();
+  }
   callback(std::static_pointer_cast<CommandResData>(respCmd));
 }
 
-void DefaultCecHandler::HandleListAdaptersCb(std::vector<std::string> resp) {
-  AppLogInfo()<<" DefaultCecHandler::"<<__func__<<":"<<__LINE__;
+void DefaultCecHandler::HandleListAdaptersCb(std::shared_ptr<Command> command, const ResponseBuffer &resp) {
+  AppLogDebug()<<" DefaultCecHandler::"<<__func__<<":"<<__LINE__;
   AppLogDebug()<<"LISTADAPTERS_COMMAND Response : START";
   printResp(resp);
   AppLogDebug()<<"LISTADAPTERS_COMMAND Response : END";
 
-  std::shared_ptr<Command> command;
-  {
-    std::unique_lock<std::mutex> lock(mMutex);
-    command = mCmdList.front();
-    if (command->getType() != LIST_ADAPTERS)
-      return;
-    mCmdList.pop_front();
-  }
-
-  std::shared_ptr<ListAdaptersResData> respCmd = std::make_shared<ListAdaptersResData>();
+  std::shared_ptr<ListAdaptersResData> respCmd = makePooled<ListAdaptersResData>();
   CommandCallback callback = command->getCallback();
   respCmd->returnValue = true;
 
@@ -478,22 +773,13 @@ void DefaultCecHandler::HandleListAdaptersCb(std::vector<std::string> resp) {
   callback(std::static_pointer_cast<CommandResData>(respCmd));
 }
 
-void DefaultCecHandler::HandleGetConfigCb(std::vector<std::string> resp) {
-  AppLogInfo()<<" DefaultCecHandler::"<<__func__<<":"<<__LINE__;
+void DefaultCecHandler::HandleGetConfigCb(std::shared_ptr<Command> command, const ResponseBuffer &resp) {
+  AppLogDebug()<<" DefaultCecHandler::"<<__func__<<":"<<__LINE__;
   AppLogDebug()<<"GETCONFIG_COMMAND Response : START";
   printResp(resp);
   AppLogDebug()<<"GETCONFIG_COMMAND Response : END";
 
-  std::shared_ptr<Command> command;
-  {
-    std::unique_lock<std::mutex> lock(mMutex);
-    command = mCmdList.front();
-    if (command->getType() != GET_CONFIG)
-      return;
-    mCmdList.pop_front();
-  }
-
-  std::shared_ptr<GetConfigResData> respCmd = std::make_shared<GetConfigResData>();
+  std::shared_ptr<GetConfigResData> respCmd = makePooled<GetConfigResData>();
   CommandCallback callback = command->getCallback();
   respCmd->returnValue = true;
 
@@ -574,22 +860,13 @@ void DefaultCecHandler::HandleGetConfigCb(std::vector<std::string> resp) {
   callback(std::static_pointer_cast<CommandResData>(respCmd));
 }
 
-void DefaultCecHandler::HandleSetConfigCb(std::vector<std::string> resp) {
-  AppLogInfo()<<" DefaultCecHandler::"<<__func__<<":"<<__LINE__;
+void DefaultCecHandler::HandleSetConfigCb(std::shared_ptr<Command> command, const ResponseBuffer &resp) {
+  AppLogDebug()<<" DefaultCecHandler::"<<__func__<<":"<<__LINE__;
   AppLogDebug()<<"SETCONFIG_COMMAND Response : START";
   printResp(resp);
   AppLogDebug()<<"SETCONFIG_COMMAND Response : END";
 
-  std::shared_ptr<Command> command;
-  {
-    std::unique_lock<std::mutex> lock(mMutex);
-    command = mCmdList.front();
-    if (command->getType() != SET_CONFIG)
-      return;
-    mCmdList.pop_front();
-  }
-
-  std::shared_ptr<CommandResData> respCmd = std::make_shared<CommandResData>();
+  std::shared_ptr<CommandResData> respCmd = makePooled<CommandResData>();
   CommandCallback callback = command->getCallback();
   respCmd->returnValue = true;
 
@@ -604,8 +881,100 @@ void DefaultCecHandler::HandleSetConfigCb(std::vector<std::string> resp) {
   callback(std::move(respCmd));
 }
 
+void DefaultCecHandler::HandleSendFrameCb(std::shared_ptr<Command> command, const ResponseBuffer &resp, bool probe) {
+  AppLogDebug()<<" DefaultCecHandler::"<<__func__<<":"<<__LINE__;
+  printResp(resp);
+
+  std::shared_ptr<SendFrameReqData> frameData = std::static_pointer_cast<SendFrameReqData>(command->getData());
+  std::shared_ptr<SendFrameResData> respCmd = makePooled<SendFrameResData>();
+  CommandCallback callback = command->getCallback();
+  respCmd->returnValue = true;
+
+  CecErrorCode error = CEC_ERR_UNKNOWN_ERROR;
+  bool failed = false;
+  for (auto it=resp.begin(); it!=resp.end(); ++it) {
+    CecFrame frame;
+    if ((*it).find("response") != std::string::npos) {
+      std::string value = GetValue(*it);
+      // Never reached the bus, says nothing about the destination
+      if (value == "unsupported")
+        failed = true;
+      else if (value != "success") {
+        error = CEC_ERR_FRAME_NOT_ACKNOWLEDGED;
+        failed = true;
+      }
+    } else if (parseIncomingFrame(*it, frame) && frame.initiator == frameData->frame.destination) {
+      respCmd->hasReply = true;
+      respCmd->reply = frame;
+    }
+  }
+
+  std::string errorText = retrieveErrorText(error);
+  if (respCmd->hasReply && respCmd->reply.hasOpcode && respCmd->reply.opcode == CEC_OPCODE_FEATURE_ABORT
+      && respCmd->reply.length && respCmd->reply.operands[0] == frameData->frame.opcode) {
+    error = CEC_ERR_CMD_ABORTED_BY_TARGET_DEVICE;
+    uint8_t reason = respCmd->reply.length >= 2 ? respCmd->reply.operands[1] : 0;
+    errorText = retrieveErrorText(error) + " (" + cecAbortReasonString(reason) + ")";
+    failed = true;
+  }
+
+  // Probes go out at scan priority on a busy bus, what they miss says
+  // little about the device
+  if (error != CEC_ERR_FRAME_NOT_ACKNOWLEDGED && !probe)
+    LearnCapability(frameData->adapter, frameData->frame, respCmd->hasReply, respCmd->reply, frameData->timeout);
+
+  if (failed) {
+    respCmd->returnValue = false;
+    respCmd->error = makePooled<ErrorInfo>(ErrorInfo{error, errorText});
+  }
+  callback(std::static_pointer_cast<CommandResData>(respCmd));
+}
+
+void DefaultCecHandler::RespondWithError(std::shared_ptr<Command> command, const ErrorInfo &errInfo) {
+  if (command->isCancelled())
+    return;
+
+  CommandCallback callback = command->getCallback();
+  std::shared_ptr<CommandResData> respCmd;
+
+  switch(command->getType()) {
+    case SEND_COMMAND:
+      respCmd = std::static_pointer_cast<CommandResData>(makePooled<SendCommandResData>());
+    break;
+
+    case LIST_ADAPTERS:
+      respCmd = std::static_pointer_cast<CommandResData>(makePooled<ListAdaptersResData>());
+    break;
+
+    case SCAN:
+      respCmd = std::static_pointer_cast<CommandResData>(makePooled<ScanResData>());
+    break;
+
+    case GET_CONFIG:
+      respCmd = std::static_pointer_cast<CommandResData>(makePooled<GetConfigResData>());
+    break;
+
+    case SET_CONFIG:
+      respCmd = makePooled<CommandResData>();
+    break;
+
+    case SEND_FRAME:
+      respCmd = std::static_pointer_cast<CommandResData>(makePooled<SendFrameResData>());
+    break;
+
+    default:
+      AppLogError()<<" DefaultCecHandler::"<<__func__<<":"<<__LINE__<<" Invalid command type";
+      respCmd = makePooled<CommandResData>();
+    break;
+  }
+
+  respCmd->returnValue = false;
+  respCmd->error = makePooled<ErrorInfo>(ErrorInfo{errInfo.errorCode, errInfo.errorText});
+  callback(std::static_pointer_cast<CommandResData>(respCmd));
+}
+
 bool DefaultCecHandler::HandleCommand(std::shared_ptr<Command> command) {
-  AppLogInfo()<<" DefaultCecHandler::"<<__func__<<":"<<__LINE__;
+  AppLogDebug()<<" DefaultCecHandler::"<<__func__<<":"<<__LINE__;
 
   ErrorInfo errInfo;
   bool errorFound = false;
@@ -630,54 +999,24 @@ bool DefaultCecHandler::HandleCommand(std::shared_ptr<Command> command) {
       errInfo.errorText="Destination device not found";
       errorFound = true;
     break;
+    case HANDLER_ERROR_DESTINATION_UNAVAILABLE:
+      errInfo.errorCode=CEC_ERR_DEST_DEVICE_UNAVAILABLE;
+      errInfo.errorText=retrieveErrorText(CEC_ERR_DEST_DEVICE_UNAVAILABLE);
+      errorFound = true;
+    break;
+    case HANDLER_ERROR_DESTINATION_UNKNOWN:
+      DiscoverDestination(command);
+      return true;
 
     default:
     break;
   }
 
   if (errorFound) {
-
-    CommandCallback callback = command->getCallback();
-    std::shared_ptr<CommandResData> respCmd;
-
-    switch(command->getType()) {
-      case SEND_COMMAND:
-        respCmd = std::static_pointer_cast<CommandResData>(std::make_shared<SendCommandResData>());
-      break;
-
-      case LIST_ADAPTERS:
-        respCmd = std::static_pointer_cast<CommandResData>(std::make_shared<ListAdaptersResData>());
-      break;
-
-      case SCAN:
-        respCmd = std::static_pointer_cast<CommandResData>(std::make_shared<ScanResData>());
-      break;
-
-      case GET_CONFIG:
-        respCmd = std::static_pointer_cast<CommandResData>(std::make_shared<GetConfigResData>());
-      break;
-
-      case SET_CONFIG:
-        respCmd = std::make_shared<CommandResData>();
-      break;
-
-      default:
-        AppLogError()<<" DefaultCecHandler::"<<__func__<<":"<<__LINE__<<" Invalid command type";
-        respCmd = std::make_shared<CommandResData>();
-      break;
-    }
-
-    respCmd->returnValue = false;
-    respCmd->error = std::make_shared<ErrorInfo>(ErrorInfo{errInfo.errorCode, errInfo.errorText});
-    callback(std::static_pointer_cast<CommandResData>(respCmd));
+    RespondWithError(command, errInfo);
     return true;
   }
 
-  {
-    std::unique_lock<std::mutex> lock(mMutex);
-    mCmdList.push_back(command);
-  }
-
   switch(command->getType()) {
     case SEND_COMMAND:
       return HandleSendCommand(command);
@@ -694,6 +1033,9 @@ bool DefaultCecHandler::HandleCommand(std::shared_ptr<Command> command) {
     case SET_CONFIG:
       return HandleSetConfig(command);
 
+    case SEND_FRAME:
+      return HandleSendFrame(command);
+
     default:
      AppLogError()<<" DefaultCecHandler::"<<__func__<<":"<<__LINE__<<" Invalid command type";
       return false;
@@ -701,7 +1043,7 @@ bool DefaultCecHandler::HandleCommand(std::shared_ptr<Command> command) {
 }
 
 std::shared_ptr<CecDevice> DefaultCecHandler::GetDeviceInfo(std::string destAddress) {
-  AppLogInfo()<<" DefaultCecHandler::"<<__func__<<":"<<__LINE__;
+  AppLogDebug()<<" DefaultCecHandler::"<<__func__<<":"<<__LINE__;
   std::unique_lock < std::mutex > lock(mMutex);
   for (auto it=mDeviceInfoList.begin(); it!=mDeviceInfoList.end(); ++it) {
     if ((*it).getAddress() == destAddress) {
@@ -713,27 +1055,33 @@ std::shared_ptr<CecDevice> DefaultCecHandler::GetDeviceInfo(std::string destAddr
 }
 
 bool DefaultCecHandler::HandleSendCommand(std::shared_ptr<Command> command) {
-  std::shared_ptr<MessageData> msgData = std::make_shared<MessageData>();
+  std::shared_ptr<MessageData> msgData = makePooled<MessageData>();
   std::shared_ptr<SendCommandReqData> commandData = std::static_pointer_cast<SendCommandReqData>(command->getData());
 
   msgData->type = SEND_COMMAND;
+  msgData->command = command;
+  msgData->priority = GetCommandPriority(commandData->command);
+  msgData->deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(commandData->timeout);
+  msgData->destination = ResolveLogicalAddress(commandData->adapter, commandData->destAddress);
+
+  uint8_t opcode;
+  if (GetCommandOpcode(commandData->command, opcode)
+      && FailKnownUnsupported(command, commandData->adapter, msgData->destination, opcode))
+    return true;
 
   if (!commandData->adapter.empty())
-    msgData->params["adapter"] = commandData->adapter;
-  msgData->params["destAddress"] = commandData->destAddress;
-  msgData->params["timeout"] = std::to_string(commandData->timeout);
-  msgData->params["cmd-name"] = commandData->command.name;
+    msgData->params.set(PARAM_ADAPTER, commandData->adapter);
+  msgData->params.set(PARAM_DEST_ADDRESS, commandData->destAddress);
+  msgData->params.set(PARAM_TIMEOUT, std::to_string(commandData->timeout));
+  msgData->params.set(PARAM_CMD_NAME, commandData->command.name);
 
   for (auto it = commandData->command.args.begin();  it!=commandData->command.args.end(); ++it) {
 
-    AppLogInfo()<<" DefaultCecHandler::"<<__func__<<":"<<__LINE__<<" arg: "<<(*it).arg;
- 
-    if (!((*it).value.empty())) {
-      msgData->params[(*it).arg] = (*it).value;
-      AppLogInfo()<<" DefaultCecHandler::"<<__func__<<":"<<__LINE__<<" arg: "<<(*it).arg<<" value: "<<(*it).value;
-    } else {
-      AppLogInfo()<<" DefaultCecHandler::"<<__func__<<":"<<__LINE__<<" arg: "<<(*it).arg;
-      msgData->params[(*it).arg];
+    AppLogDebug()<<" DefaultCecHandler::"<<__func__<<":"<<__LINE__<<" arg: "<<(*it).arg<<" value: "<<(*it).value;
+    ParamKey key;
+    if (!findParamKey((*it).arg, key) || !msgData->params.set(key, (*it).value)) {
+      RespondWithError(command, ErrorInfo{CEC_INVALID_INPUT_PARAM, retrieveErrorText(CEC_INVALID_INPUT_PARAM)});
+      return true;
     }
   }
   mQueue.addMessage(std::move(msgData));
@@ -741,26 +1089,650 @@ bool DefaultCecHandler::HandleSendCommand(std::shared_ptr<Command> command) {
   return true;
 }
 
+MessagePriority DefaultCecHandler::GetCommandPriority(const CecCommand &command) {
+  return isControlCommand(command) ? PRIORITY_CONTROL : PRIORITY_QUERY;
+}
+
+// Message a command puts on the bus, for the commands that send a single
+// directed one
+bool DefaultCecHandler::GetCommandOpcode(const CecCommand &command, uint8_t &opcode) {
+  if (command.args.size() != 1)
+    return false;
+  const CecCommandArg &arg = command.args.front();
+
+  if (command.name == "report-power-status" && arg.value.empty())
+    opcode = CEC_OPCODE_GIVE_DEVICE_POWER_STATUS;
+  else if (command.name == "report-audio-status" && arg.value.empty())
+    opcode = CEC_OPCODE_GIVE_AUDIO_STATUS;
+  else if (command.name == "osd-display")
+    opcode = CEC_OPCODE_SET_OSD_STRING;
+  else if (command.name == "system-information" && arg.arg == "name")
+    opcode = CEC_OPCODE_GIVE_OSD_NAME;
+  else if (command.name == "system-information" && arg.arg == "version")
+    opcode = CEC_OPCODE_GET_CEC_VERSION;
+  else if (command.name == "system-information" && arg.arg == "vendor-id")
+    opcode = CEC_OPCODE_GIVE_DEVICE_VENDOR_ID;
+  else if (command.name == "system-information" && arg.arg == "language")
+    opcode = CEC_OPCODE_GET_MENU_LANGUAGE;
+  else
+    return false;
+  return true;
+}
+
+// Key the capability cache knows the device at the logical address by
+bool DefaultCecHandler::GetCapabilityKey(const std::string &adapter, int logicalAddress, std::string &vendor,
+                                         uint16_t &physical) {
+  const std::string &name = adapter.empty() ? DEFAULT_CEC_ADAPTER : adapter;
+  std::unique_lock<std::mutex> lock(mMutex);
+  for (auto it = mDeviceInfoList.begin(); it != mDeviceInfoList.end(); ++it) {
+    if ((*it).getAdapter() != name || (*it).getLogicalAddress() != logicalAddress)
+      continue;
+    if ((*it).getPhysicalAddress() == CEC_INVALID_PHYSICAL_ADDRESS)
+      return false;
+    vendor = (*it).getVendor();
+    physical = (*it).getPhysicalAddress();
+    return true;
+  }
+  return false;
+}
+
+// Answers the command right away when the device is known not to handle
+// the opcode, instead of spending bus time to learn that again
+bool DefaultCecHandler::FailKnownUnsupported(std::shared_ptr<Command> command, const std::string &adapter, int destination,
+                                             uint8_t opcode) {
+  std::string vendor;
+  uint16_t physical;
+  CapabilityCache::Entry entry;
+  if (destination < 0 || !GetCapabilityKey(adapter, destination, vendor, physical)
+      || !CapabilityCache::instance().lookup(vendor, physical, opcode, entry))
+    return false;
+
+  AppLogInfo()<<" DefaultCecHandler::"<<__func__<<":"<<__LINE__<<" "<<cecOpcodeName(opcode)
+              <<" unsupported by "<<destination;
+  if (entry.failure == CAPABILITY_ABORTED) {
+    RespondWithError(command, ErrorInfo{CEC_ERR_CMD_ABORTED_BY_TARGET_DEVICE,
+        retrieveErrorText(CEC_ERR_CMD_ABORTED_BY_TARGET_DEVICE) + " (" + cecAbortReasonString(entry.reason) + ")"});
+  } else {
+    RespondWithError(command, ErrorInfo{CEC_ERR_CMD_UNSUPPORTED_BY_DEVICE,
+        retrieveErrorText(CEC_ERR_CMD_UNSUPPORTED_BY_DEVICE)});
+  }
+  return true;
+}
+
+// Called with the outcome of an acknowledged directed frame. Requests
+// answered with neither their reply nor <Feature Abort> within timeout
+// count as unhandled.
+void DefaultCecHandler::LearnCapability(const std::string &adapter, const CecFrame &frame, bool hasReply,
+                                        const CecFrame &reply, int32_t timeout) {
+  std::string vendor;
+  uint16_t physical;
+  if (!frame.hasOpcode || frame.isBroadcast() || !GetCapabilityKey(adapter, frame.destination, vendor, physical))
+    return;
+
+  CapabilityCache &cache = CapabilityCache::instance();
+  if (hasReply && reply.hasOpcode && reply.opcode == CEC_OPCODE_FEATURE_ABORT
+      && reply.length && reply.operands[0] == frame.opcode) {
+    cache.recordAbort(vendor, physical, frame.opcode, reply.length >= 2 ? reply.operands[1] : 0);
+    return;
+  }
+
+  uint8_t expected;
+  if (!cecExpectedReply(frame.opcode, expected))
+    return;
+  if (hasReply && reply.hasOpcode && reply.opcode == expected) {
+    cache.recordSuccess(vendor, physical, frame.opcode);
+    return;
+  }
+  if (hasReply)
+    return;
+
+  // The reply may still come on its own as an event
+  std::shared_ptr<ReplyWait> wait = std::make_shared<ReplyWait>(ReplyWait{adapter, frame, expected, vendor, physical, false});
+  {
+    std::unique_lock<std::mutex> lock(mReplyWaitsMutex);
+    mReplyWaits.push_back(wait);
+  }
+  g_timeout_add(static_cast<guint>(timeout), &DefaultCecHandler::ReplyTimeoutCb, new std::shared_ptr<ReplyWait>(wait));
+}
+
+// Settles the requests a frame from a device answers
+void DefaultCecHandler::MatchReplyWaits(const std::string &adapter, const CecFrame &frame) {
+  std::list<std::shared_ptr<ReplyWait>> answered;
+  {
+    std::unique_lock<std::mutex> lock(mReplyWaitsMutex);
+    for (auto it = mReplyWaits.begin(); it != mReplyWaits.end();) {
+      const ReplyWait &wait = **it;
+      bool aborted = frame.opcode == CEC_OPCODE_FEATURE_ABORT && frame.length && frame.operands[0] == wait.frame.opcode;
+      if (wait.adapter != adapter || wait.frame.destination != frame.initiator
+          || (frame.opcode != wait.expected && !aborted)) {
+        ++it;
+        continue;
+      }
+      (*it)->answered = true;
+      answered.push_back(*it);
+      it = mReplyWaits.erase(it);
+    }
+  }
+
+  CapabilityCache &cache = CapabilityCache::instance();
+  for (auto &wait : answered) {
+    if (frame.opcode == wait->expected)
+      cache.recordSuccess(wait->vendor, wait->physical, wait->frame.opcode);
+    else
+      cache.recordAbort(wait->vendor, wait->physical, wait->frame.opcode, frame.length >= 2 ? frame.operands[1] : 0);
+  }
+}
+
+gboolean DefaultCecHandler::ReplyTimeoutCb(gpointer data) {
+  std::unique_ptr<std::shared_ptr<ReplyWait>> wait(static_cast<std::shared_ptr<ReplyWait>*>(data));
+  {
+    std::unique_lock<std::mutex> lock(mReplyWaitsMutex);
+    if ((*wait)->answered)
+      return G_SOURCE_REMOVE;
+    mReplyWaits.remove(*wait);
+  }
+  CapabilityCache::instance().recordNoReply((*wait)->vendor, (*wait)->physical, (*wait)->frame.opcode);
+  return G_SOURCE_REMOVE;
+}
+
 bool DefaultCecHandler::HandleScan(std::shared_ptr<Command> command) {
-  AppLogInfo()<<" DefaultCecHandler::"<<__func__<<":"<<__LINE__;
-  std::shared_ptr<MessageData> msgData = std::make_shared<MessageData>();
+  AppLogDebug()<<" DefaultCecHandler::"<<__func__<<":"<<__LINE__;
   std::shared_ptr<ScanReqData> scanData = std::static_pointer_cast<ScanReqData>(command->getData());
 
+  if (scanData->adapter == SCAN_ALL_ADAPTERS) {
+    HandleScanAll(std::move(command));
+    return true;
+  }
+  StartScan(std::move(command), scanData->adapter, scanData->incremental);
+
+  return true;
+}
+
+// Lowest priority, a refresh never holds up client traffic
+void DefaultCecHandler::RefreshTopology(bool full) {
+  std::vector<std::string> adapters;
+  {
+    std::unique_lock<std::mutex> lock(mMutex);
+    adapters.assign(mAdaptersList.begin(), mAdaptersList.end());
+  }
+  AppLogDebug()<<" DefaultCecHandler::"<<__func__<<":"<<__LINE__<<" full: "<<full<<" adapters: "<<adapters.size();
+  if (adapters.empty()) {
+    mRefresher.RefreshDone(false);
+    return;
+  }
+
+  std::shared_ptr<RefreshContext> ctx = std::make_shared<RefreshContext>();
+  ctx->pending = adapters.size();
+  ctx->changed = full;
+  auto adapterDone = [this, ctx](bool changed) {
+    std::unique_lock<std::mutex> lock(ctx->mutex);
+    ctx->changed = ctx->changed || changed;
+    if (--ctx->pending)
+      return;
+    lock.unlock();
+    mRefresher.RefreshDone(ctx->changed);
+  };
+
+  for (auto &adapter : adapters) {
+    std::shared_ptr<ScanReqData> scanData = makePooled<ScanReqData>();
+    scanData->adapter = adapter;
+    scanData->incremental = !full;
+    if (full) {
+      std::shared_ptr<Command> command = makePooled<Command>(CommandType::SCAN,
+          [adapterDone](std::shared_ptr<CommandResData> respData) { adapterDone(true); });
+      command->setData(scanData);
+      QueueScan(std::move(command), adapter, PRIORITY_BACKGROUND);
+      continue;
+    }
+    std::shared_ptr<Command> command = makePooled<Command>(CommandType::SCAN,
+        [](std::shared_ptr<CommandResData> respData) {});
+    command->setData(scanData);
+    ProbeAddresses(std::move(command), adapter, -1, false, PRIORITY_BACKGROUND,
+        [adapterDone](std::shared_ptr<ScanResData> respCmd, bool changed) { adapterDone(changed); });
+  }
+}
+
+// Devices announce themselves with a broadcast <Report Physical Address>
+// when plugged in, and the bus is taken to standby with a broadcast
+// <Standby>. Anything that starts a device again ends standby.
+void DefaultCecHandler::TrackTopologyEvent(const CecFrame &frame) {
+  if (!frame.hasOpcode)
+    return;
+
+  switch (frame.opcode) {
+    case CEC_OPCODE_REPORT_PHYSICAL_ADDRESS:
+      if (!frame.isBroadcast())
+        return;
+      mRefresher.SetStandby(false);
+      mRefresher.NotifyHotPlug();
+      return;
+
+    case CEC_OPCODE_STANDBY:
+      if (frame.isBroadcast())
+        mRefresher.SetStandby(true);
+      return;
+
+    case CEC_OPCODE_ACTIVE_SOURCE:
+    case CEC_OPCODE_IMAGE_VIEW_ON:
+    case CEC_OPCODE_TEXT_VIEW_ON:
+    case CEC_OPCODE_ROUTING_CHANGE:
+      mRefresher.SetStandby(false);
+      return;
+
+    default:
+      return;
+  }
+}
+
+void DefaultCecHandler::StartScan(std::shared_ptr<Command> command, const std::string &adapter, bool incremental) {
+  if (incremental)
+    HandleIncrementalScan(std::move(command), adapter);
+  else
+    QueueScan(std::move(command), adapter, PRIORITY_SCAN);
+}
+
+void DefaultCecHandler::QueueScan(std::shared_ptr<Command> command, const std::string &adapter, MessagePriority priority) {
+  std::shared_ptr<MessageData> msgData = makePooled<MessageData>();
+
   msgData->type = SCAN;
-  if (!scanData->adapter.empty())
-    msgData->params["adapter"] = scanData->adapter;
+  msgData->command = std::move(command);
+  msgData->priority = priority;
+  msgData->deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(SCAN_TIMEOUT_MS);
+  if (!adapter.empty())
+    msgData->params.set(PARAM_ADAPTER, adapter);
 
-  mQueue.addMessage(std::move(msgData));
+  GetScanQueue(adapter).addMessage(std::move(msgData));
+}
 
-  return true;
+// Scans every known adapter on its own engine and answers with all devices
+// found, each tagged with its adapter. Takes as long as the slowest adapter.
+void DefaultCecHandler::HandleScanAll(std::shared_ptr<Command> command) {
+  bool incremental = std::static_pointer_cast<ScanReqData>(command->getData())->incremental;
+  std::vector<std::string> adapters;
+  {
+    std::unique_lock<std::mutex> lock(mMutex);
+    adapters.assign(mAdaptersList.begin(), mAdaptersList.end());
+  }
+  if (adapters.empty()) {
+    RespondWithError(command, ErrorInfo{CEC_ERR_NO_CEC_ADAPTER_FOUND, retrieveErrorText(CEC_ERR_NO_CEC_ADAPTER_FOUND)});
+    return;
+  }
+
+  std::shared_ptr<ScanAllContext> ctx = std::make_shared<ScanAllContext>();
+  ctx->command = std::move(command);
+  ctx->pending = adapters.size();
+  ctx->results.resize(adapters.size());
+
+  for (size_t i = 0; i < adapters.size(); i++) {
+    std::shared_ptr<Command> adapterScan = makePooled<Command>(CommandType::SCAN,
+        [ctx, i](std::shared_ptr<CommandResData> respData) {
+          std::unique_lock<std::mutex> lock(ctx->mutex);
+          if (ctx->answered)
+            return;
+          ctx->results[i] = std::static_pointer_cast<ScanResData>(respData);
+          if (--ctx->pending)
+            return;
+          ctx->answered = true;
+          lock.unlock();
+          AnswerScanAll(ctx);
+        });
+    std::shared_ptr<ScanReqData> scanData = makePooled<ScanReqData>();
+    scanData->adapter = adapters[i];
+    scanData->incremental = incremental;
+    adapterScan->setData(scanData);
+    // Queued frames and probes of every adapter stop when the client cancels
+    adapterScan->setParent(ctx->command);
+    StartScan(std::move(adapterScan), adapters[i], incremental);
+  }
+  g_timeout_add(SCAN_TIMEOUT_MS, &DefaultCecHandler::ScanAllTimeoutCb, new std::shared_ptr<ScanAllContext>(ctx));
+}
+
+// Answers with what the adapters that reported so far found
+gboolean DefaultCecHandler::ScanAllTimeoutCb(gpointer data) {
+  std::unique_ptr<std::shared_ptr<ScanAllContext>> ctx(static_cast<std::shared_ptr<ScanAllContext>*>(data));
+  size_t pending;
+  {
+    std::unique_lock<std::mutex> lock((*ctx)->mutex);
+    if ((*ctx)->answered)
+      return G_SOURCE_REMOVE;
+    (*ctx)->answered = true;
+    pending = (*ctx)->pending;
+  }
+  AppLogWarning()<<" DefaultCecHandler::"<<__func__<<":"<<__LINE__<<" "<<pending<<" adapters did not answer the scan";
+  AnswerScanAll(*ctx);
+  return G_SOURCE_REMOVE;
+}
+
+// Called once, with no more results coming in
+void DefaultCecHandler::AnswerScanAll(std::shared_ptr<ScanAllContext> ctx) {
+  if (ctx->command->isCancelled())
+    return;
+  // Partial results beat an error, fail only when no adapter answered
+  std::shared_ptr<ScanResData> merged = makePooled<ScanResData>();
+  merged->returnValue = false;
+  for (auto &result : ctx->results) {
+    if (!result)
+      continue;
+    if (!result->returnValue) {
+      if (!merged->error)
+        merged->error = result->error;
+      continue;
+    }
+    merged->returnValue = true;
+    merged->devices.splice(merged->devices.end(), result->devices);
+  }
+  if (merged->returnValue)
+    merged->error.reset();
+  else if (!merged->error)
+    merged->error = makePooled<ErrorInfo>(ErrorInfo{CEC_ERR_DEADLINE_EXCEEDED, retrieveErrorText(CEC_ERR_DEADLINE_EXCEEDED)});
+  ctx->command->getCallback()(std::static_pointer_cast<CommandResData>(merged));
+}
+
+static int MissingFields(const CecDevice &device) {
+  int missing = 0;
+  if (device.getAddress().empty())
+    missing |= SCAN_FIELD_ADDRESS;
+  if (device.getVendor().empty())
+    missing |= SCAN_FIELD_VENDOR;
+  if (device.getOsd().empty())
+    missing |= SCAN_FIELD_OSD;
+  return missing;
+}
+
+// Frame that tells whether a device is at the address of the probe. A bare
+// <Polling Message> is an empty vendor-commands payload, which only
+// backends built with NYX_RAW_POLLS take. Otherwise the mandatory
+// <Give Physical Address> is acknowledged the same way and its reply fills
+// in the address too.
+static CecFrame PresenceFrame(ScanProbe &probe) {
+  CecFrame frame;
+  frame.destination = probe.address;
+#ifndef NYX_RAW_POLLS
+  frame.hasOpcode = true;
+  frame.opcode = CEC_OPCODE_GIVE_PHYSICAL_ADDRESS;
+  probe.asked |= SCAN_FIELD_ADDRESS;
+#endif
+  return frame;
+}
+
+// Rediscovers the bus frame by frame instead of through a backend scan.
+// Devices heard from within SCAN_FRESHNESS_MS are not polled and only
+// fields still missing are asked for, so a rescan of a settled bus costs
+// a handful of frames.
+void DefaultCecHandler::HandleIncrementalScan(std::shared_ptr<Command> command, const std::string &adapter) {
+  CommandCallback callback = command->getCallback();
+  ProbeAddresses(std::move(command), adapter, -1, false, PRIORITY_SCAN,
+                 [callback](std::shared_ptr<ScanResData> respCmd, bool changed) {
+    callback(std::static_pointer_cast<CommandResData>(respCmd));
+  });
+}
+
+// Probes the logical addresses of the adapter, or only onlyAddress when it
+// is not -1, and answers done with every device found. With unknownOnly,
+// devices already in the table are left alone and not reported.
+void DefaultCecHandler::ProbeAddresses(std::shared_ptr<Command> command, const std::string &adapter, int onlyAddress,
+                                       bool unknownOnly,
+                                       MessagePriority priority, std::function<void(std::shared_ptr<ScanResData>, bool)> done) {
+  std::shared_ptr<IncrementalScan> scan = std::make_shared<IncrementalScan>();
+  scan->command = std::move(command);
+  scan->done = std::move(done);
+  scan->adapter = adapter.empty() ? DEFAULT_CEC_ADAPTER : adapter;
+  scan->priority = priority;
+
+  auto now = std::chrono::steady_clock::now();
+  std::vector<std::shared_ptr<ScanProbe>> probes;
+  {
+    std::unique_lock<std::mutex> lock(mMutex);
+    for (uint8_t address = 0; address < CEC_BROADCAST_ADDRESS; address++) {
+      if (onlyAddress >= 0 && address != onlyAddress)
+        continue;
+      auto it = mDeviceInfoList.begin();
+      for (; it != mDeviceInfoList.end(); ++it) {
+        if ((*it).getAdapter() == scan->adapter && (*it).getLogicalAddress() == address)
+          break;
+      }
+
+      if (it == mDeviceInfoList.end()) {
+        CecDevice dev {cecLogicalAddressName(address), "", "no", "", "", "", "", ""};
+        dev.setLogicalAddress(address);
+        dev.setAdapter(scan->adapter);
+        probes.push_back(std::make_shared<ScanProbe>(ScanProbe{scan, address, std::move(dev), false, 0, false}));
+        continue;
+      }
+      if (unknownOnly)
+        continue;
+
+      bool fresh = now - (*it).getLastSeen() < std::chrono::milliseconds(SCAN_FRESHNESS_MS);
+      if (fresh && !MissingFields(*it)) {
+        scan->found.push_back(*it);
+        continue;
+      }
+      probes.push_back(std::make_shared<ScanProbe>(ScanProbe{scan, address, *it, fresh, 0, true}));
+    }
+  }
+
+  AppLogDebug()<<" DefaultCecHandler::"<<__func__<<":"<<__LINE__<<" probing "<<probes.size()<<" addresses on "<<scan->adapter;
+  scan->pending = probes.size();
+  if (probes.empty()) {
+    FinishIncrementalScan(std::move(scan));
+    return;
+  }
+
+  for (auto &probe : probes) {
+    if (probe->answered) {
+      NextProbeStep(probe);
+      continue;
+    }
+    SendProbe(probe, PresenceFrame(*probe));
+  }
+}
+
+// A probe waits behind everything of higher priority on the scan queue, a
+// scan probe may take as long as the scan it belongs to. Background
+// probes yield to all other traffic and have no deadline at all.
+static std::chrono::steady_clock::time_point ProbeDeadline(MessagePriority priority) {
+  if (priority == PRIORITY_BACKGROUND)
+    return std::chrono::steady_clock::time_point::max();
+  int timeout = priority == PRIORITY_SCAN ? SCAN_TIMEOUT_MS : DEFAULT_REPLY_TIMEOUT_MS;
+  return std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+}
+
+void DefaultCecHandler::SendProbe(std::shared_ptr<ScanProbe> probe, const CecFrame &frame) {
+  const std::string &adapter = probe->scan->adapter;
+  std::shared_ptr<SendFrameReqData> frameData = makePooled<SendFrameReqData>();
+  frameData->adapter = adapter;
+  frameData->frame = frame;
+
+  std::shared_ptr<Command> command = makePooled<Command>(CommandType::SEND_FRAME,
+      [this, probe](std::shared_ptr<CommandResData> respData) {
+        HandleProbeReply(probe, std::static_pointer_cast<SendFrameResData>(respData));
+      });
+  command->setData(frameData);
+
+  std::shared_ptr<MessageData> msgData = makePooled<MessageData>();
+  msgData->type = SEND_FRAME;
+  msgData->command = std::move(command);
+  msgData->priority = probe->scan->priority;
+  msgData->deadline = ProbeDeadline(msgData->priority);
+  msgData->destination = frame.destination;
+  msgData->adapter = adapter;
+  msgData->frame = frame;
+  msgData->probe = true;
+  // No acknowledge is the usual answer to a poll, not worth a retry
+  if (!probe->answered)
+    msgData->attempts = RetryPolicy::GetBudget(SEND_FRAME);
+
+  GetScanQueue(adapter).addMessage(std::move(msgData));
+}
+
+void DefaultCecHandler::HandleProbeReply(std::shared_ptr<ScanProbe> probe, std::shared_ptr<SendFrameResData> resp) {
+  if (!probe->answered) {
+    int error = resp->error ? resp->error->errorCode : CEC_ERR_UNKNOWN_ERROR;
+    // A <Feature Abort> still comes from a device that is there
+    if (!resp->returnValue && error != CEC_ERR_CMD_ABORTED_BY_TARGET_DEVICE) {
+      // Only a poll nobody acknowledged proves the address is free. A probe
+      // that timed out or failed on the way says nothing, so a device
+      // already in the table is kept as it is.
+      if (error == CEC_ERR_FRAME_NOT_ACKNOWLEDGED) {
+        std::unique_lock<std::mutex> lock(probe->scan->mutex);
+        probe->scan->gone.push_back(probe->address);
+      }
+      bool known = probe->known;
+      FinishProbe(std::move(probe), known);
+      return;
+    }
+    probe->answered = true;
+    probe->device.touch();
+    if (resp->returnValue && resp->hasReply)
+      ApplyDeviceFrame(probe->device, resp->reply);
+  } else if (resp->hasReply) {
+    ApplyDeviceFrame(probe->device, resp->reply);
+    probe->device.touch();
+  }
+  NextProbeStep(std::move(probe));
+}
+
+// Asks for the next missing field, one frame at a time
+void DefaultCecHandler::NextProbeStep(std::shared_ptr<ScanProbe> probe) {
+  if (probe->scan->command->isCancelled()) {
+    FinishProbe(std::move(probe), true);
+    return;
+  }
+
+  int missing = MissingFields(probe->device) & ~probe->asked;
+  CecFrame frame;
+  frame.destination = probe->address;
+  frame.hasOpcode = true;
+  if (missing & SCAN_FIELD_ADDRESS) {
+    probe->asked |= SCAN_FIELD_ADDRESS;
+    frame.opcode = CEC_OPCODE_GIVE_PHYSICAL_ADDRESS;
+  } else if (missing & SCAN_FIELD_VENDOR) {
+    probe->asked |= SCAN_FIELD_VENDOR;
+    frame.opcode = CEC_OPCODE_GIVE_DEVICE_VENDOR_ID;
+  } else if (missing & SCAN_FIELD_OSD) {
+    probe->asked |= SCAN_FIELD_OSD;
+    frame.opcode = CEC_OPCODE_GIVE_OSD_NAME;
+  } else {
+    FinishProbe(std::move(probe), true);
+    return;
+  }
+  SendProbe(std::move(probe), frame);
+}
+
+void DefaultCecHandler::FinishProbe(std::shared_ptr<ScanProbe> probe, bool found) {
+  std::shared_ptr<IncrementalScan> scan = probe->scan;
+  std::unique_lock<std::mutex> lock(scan->mutex);
+  if (found)
+    scan->found.push_back(probe->device);
+  if (--scan->pending)
+    return;
+  lock.unlock();
+  FinishIncrementalScan(std::move(scan));
+}
+
+void DefaultCecHandler::FinishIncrementalScan(std::shared_ptr<IncrementalScan> scan) {
+  scan->found.sort([](const CecDevice &a, const CecDevice &b) {
+    return a.getLogicalAddress() < b.getLogicalAddress();
+  });
+
+  // Devices that left or joined, replaced ones cancel out
+  int changes = static_cast<int>(scan->found.size());
+  {
+    std::unique_lock<std::mutex> lock(mMutex);
+    mDeviceInfoList.remove_if([&scan, &changes](const CecDevice &device) {
+      if (device.getAdapter() != scan->adapter)
+        return false;
+      if (std::find(scan->gone.begin(), scan->gone.end(), device.getLogicalAddress()) != scan->gone.end()) {
+        changes++;
+        return true;
+      }
+      for (const auto &found : scan->found) {
+        if (found.getLogicalAddress() == device.getLogicalAddress()) {
+          changes--;
+          return true;
+        }
+      }
+      return false;
+    });
+    mDeviceInfoList.insert(mDeviceInfoList.end(), scan->found.begin(), scan->found.end());
+    RebuildTopology();
+  }
+
+  if (scan->command->isCancelled())
+    return;
+  std::shared_ptr<ScanResData> respCmd = makePooled<ScanResData>();
+  respCmd->returnValue = true;
+  respCmd->devices = scan->found;
+  scan->done(std::move(respCmd), changes != 0);
+}
+
+// A destination given by logical address is polled on its own. One given
+// by physical address can sit behind any logical address, so every
+// address without a device in the table is polled. Devices that answer are
+// looked up, then the command goes through the handlers again and fails
+// as usual if the destination is still not there.
+void DefaultCecHandler::DiscoverDestination(std::shared_ptr<Command> command) {
+  std::shared_ptr<SendCommandReqData> commandData = std::static_pointer_cast<SendCommandReqData>(command->getData());
+  AppLogInfo()<<" DefaultCecHandler::"<<__func__<<":"<<__LINE__<<" discovering "<<commandData->destAddress;
+  commandData->discover = false;
+
+  int logicalAddress = ParseLogicalAddress(commandData->destAddress);
+  std::string adapter = commandData->adapter;
+  ProbeAddresses(command, adapter, logicalAddress, true, PRIORITY_QUERY,
+                 [this, command](std::shared_ptr<ScanResData> respCmd, bool changed) {
+    g_idle_add(&DefaultCecHandler::DiscoveryDoneCb, new DiscoveryContext{this, command});
+  });
+}
+
+gboolean DefaultCecHandler::DiscoveryDoneCb(gpointer data) {
+  std::unique_ptr<DiscoveryContext> ctx(static_cast<DiscoveryContext*>(data));
+  if (ctx->command->isCancelled())
+    return G_SOURCE_REMOVE;
+
+  // A device that answered must now be found under the address the client
+  // gave, whether logical or physical, or the command fails once more
+  std::shared_ptr<SendCommandReqData> commandData = std::static_pointer_cast<SendCommandReqData>(ctx->command->getData());
+  if (ctx->handler->ValidateAddress(commandData->adapter, commandData->destAddress) == HANDLER_ERROR_OK)
+    AppLogInfo()<<" DefaultCecHandler::"<<__func__<<":"<<__LINE__<<" discovered "<<commandData->destAddress;
+  else
+    AppLogInfo()<<" DefaultCecHandler::"<<__func__<<":"<<__LINE__<<" "<<commandData->destAddress<<" did not answer";
+  CecController::getInstance()->HandleCommand(std::move(ctx->command));
+  return G_SOURCE_REMOVE;
+}
+
+MessageQueue& DefaultCecHandler::GetScanQueue(const std::string &adapter) {
+  std::unique_lock<std::mutex> lock(mScanQueuesMutex);
+  // A replayed trace has a single stream of responses, keep it on one engine
+  NyxTraceMode traceMode = NyxTrace::getMode();
+  if (adapter.empty() || adapter == DEFAULT_CEC_ADAPTER
+      || traceMode == NYX_TRACE_REPLAY || traceMode == NYX_TRACE_REPLAY_FAST)
+    return mQueue;
+
+  std::unique_ptr<MessageQueue> &queue = mScanQueues[adapter];
+  if (!queue) {
+    AppLogInfo()<<" DefaultCecHandler::"<<__func__<<":"<<__LINE__<<" starting scan engine for "<<adapter;
+    queue.reset(new MessageQueue(&mQueue));
+    queue->setCallback([this](std::shared_ptr<MessageData> msgData, ResponseBuffer resp) {
+      HandleResponse(std::move(msgData), std::move(resp));
+    });
+  }
+  return *queue;
+}
+
+MessageQueue& DefaultCecHandler::GetQueue(const MessageData &msgData) {
+  if (msgData.priority < PRIORITY_SCAN)
+    return mQueue;
+  const std::string *adapter = msgData.params.get(PARAM_ADAPTER);
+  return GetScanQueue(adapter ? *adapter : msgData.adapter);
 }
 
 bool DefaultCecHandler::HandleListAdapters(std::shared_ptr<Command> command) {
-  AppLogInfo()<<" DefaultCecHandler::"<<__func__<<":"<<__LINE__;
-  std::shared_ptr<MessageData> msgData = std::make_shared<MessageData>();
+  AppLogDebug()<<" DefaultCecHandler::"<<__func__<<":"<<__LINE__;
+  std::shared_ptr<MessageData> msgData = makePooled<MessageData>();
   std::shared_ptr<ListAdaptersReqData> adapterData = std::static_pointer_cast<ListAdaptersReqData>(command->getData());
 
   msgData->type = LIST_ADAPTERS;
+  msgData->command = command;
 
   mQueue.addMessage(std::move(msgData));
 
@@ -768,15 +1740,21 @@ bool DefaultCecHandler::HandleListAdapters(std::shared_ptr<Command> command) {
 }
 
 bool DefaultCecHandler::HandleGetConfig(std::shared_ptr<Command> command) {
-  AppLogInfo()<<" DefaultCecHandler::"<<__func__<<":"<<__LINE__;
-  std::shared_ptr<MessageData> msgData = std::make_shared<MessageData>();
+  AppLogDebug()<<" DefaultCecHandler::"<<__func__<<":"<<__LINE__;
+  std::shared_ptr<MessageData> msgData = makePooled<MessageData>();
   std::shared_ptr<GetConfigReqData> configData = std::static_pointer_cast<GetConfigReqData>(command->getData());
 
   msgData->type = GET_CONFIG;
+  msgData->command = command;
 
-  msgData->params[configData->key];
+  ParamKey key;
+  if (!findParamKey(configData->key, key)) {
+    RespondWithError(command, ErrorInfo{CEC_INVALID_INPUT_PARAM, retrieveErrorText(CEC_INVALID_INPUT_PARAM)});
+    return true;
+  }
+  msgData->params.set(key, "");
   if (!configData->adapter.empty())
-    msgData->params["adapter"] = configData->adapter;
+    msgData->params.set(PARAM_ADAPTER, configData->adapter);
 
   mQueue.addMessage(std::move(msgData));
 
@@ -784,15 +1762,43 @@ bool DefaultCecHandler::HandleGetConfig(std::shared_ptr<Command> command) {
 }
 
 bool DefaultCecHandler::HandleSetConfig(std::shared_ptr<Command> command) {
-  AppLogInfo()<<" DefaultCecHandler::"<<__func__<<":"<<__LINE__;
-  std::shared_ptr<MessageData> msgData = std::make_shared<MessageData>();
+  AppLogDebug()<<" DefaultCecHandler::"<<__func__<<":"<<__LINE__;
+  std::shared_ptr<MessageData> msgData = makePooled<MessageData>();
   std::shared_ptr<SetConfigReqData> configData = std::static_pointer_cast<SetConfigReqData>(command->getData());
 
   msgData->type = SET_CONFIG;
+  msgData->command = command;
 
-  msgData->params[configData->key] = configData->value;
+  ParamKey key;
+  if (!findParamKey(configData->key, key)) {
+    RespondWithError(command, ErrorInfo{CEC_INVALID_INPUT_PARAM, retrieveErrorText(CEC_INVALID_INPUT_PARAM)});
+    return true;
+  }
+  msgData->params.set(key, configData->value);
   if (!configData->adapter.empty())
-    msgData->params["adapter"] = configData->adapter;
+    msgData->params.set(PARAM_ADAPTER, configData->adapter);
+
+  mQueue.addMessage(std::move(msgData));
+
+  return true;
+}
+
+bool DefaultCecHandler::HandleSendFrame(std::shared_ptr<Command> command) {
+  AppLogDebug()<<" DefaultCecHandler::"<<__func__<<":"<<__LINE__;
+  std::shared_ptr<MessageData> msgData = makePooled<MessageData>();
+  std::shared_ptr<SendFrameReqData> frameData = std::static_pointer_cast<SendFrameReqData>(command->getData());
+
+  if (frameData->frame.hasOpcode && !frameData->frame.isBroadcast()
+      && FailKnownUnsupported(command, frameData->adapter, frameData->frame.destination, frameData->frame.opcode))
+    return true;
+
+  msgData->type = SEND_FRAME;
+  msgData->command = command;
+  msgData->priority = PRIORITY_CONTROL;
+  msgData->deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(frameData->timeout);
+  msgData->destination = frameData->frame.destination;
+  msgData->adapter = frameData->adapter;
+  msgData->frame = frameData->frame;
 
   mQueue.addMessage(std::move(msgData));
 
@@ -800,7 +1806,7 @@ bool DefaultCecHandler::HandleSetConfig(std::shared_ptr<Command> command) {
 }
 
 HandlerErrorCode DefaultCecHandler::ValidateCommand(std::shared_ptr<Command> command) {
-  AppLogInfo()<<" DefaultCecHandler::"<<__func__<<":"<<__LINE__;
+  AppLogDebug()<<" DefaultCecHandler::"<<__func__<<":"<<__LINE__;
   switch(command->getType()) {
     case SEND_COMMAND:
       return ValidateSendCommand(command);
@@ -817,6 +1823,9 @@ HandlerErrorCode DefaultCecHandler::ValidateCommand(std::shared_ptr<Command> com
     case SET_CONFIG:
       return ValidateSetConfig(command);
 
+    case SEND_FRAME:
+      return ValidateSendFrame(command);
+
     default:
      AppLogError()<<" DefaultCecHandler::"<<__func__<<":"<<__LINE__<<" Invalid command type";
       return HANDLER_ERROR_INVALID_COMMAND;
@@ -832,15 +1841,94 @@ HandlerErrorCode DefaultCecHandler::ValidateAdapter(std::string adapter) {
   return HANDLER_ERROR_INVALID_ADAPTER;
 }
 
-HandlerErrorCode DefaultCecHandler::ValidateAddress(std::string address) {
+HandlerErrorCode DefaultCecHandler::ValidateAddress(const std::string &adapter, const std::string &address) {
   std::unique_lock < std::mutex > lock(mMutex);
   for (auto it = mDeviceInfoList.begin();  it!=mDeviceInfoList.end(); ++it) {
-    if ((*it).getAddress() == address)
+    if (MatchesDestination(*it, adapter, address))
       return HANDLER_ERROR_OK;
   }
   return HANDLER_ERROR_INVALID_DESTINATION;
 }
 
+int DefaultCecHandler::ResolveLogicalAddress(const std::string &adapter, const std::string &address) {
+  std::unique_lock < std::mutex > lock(mMutex);
+  for (auto it = mDeviceInfoList.begin();  it!=mDeviceInfoList.end(); ++it) {
+    if (!MatchesDestination(*it, adapter, address))
+      continue;
+    if ((*it).getLogicalAddress() >= 0)
+      return (*it).getLogicalAddress();
+    if ((*it).hasLogicalAddress())
+      return std::strtol(address.c_str(), nullptr, 10);
+    return -1;
+  }
+  return -1;
+}
+
+HandlerErrorCode DefaultCecHandler::SendKey(const SendKeyReqData &keyData) {
+  AppLogDebug()<<" DefaultCecHandler::"<<__func__<<":"<<__LINE__<<" key: "<<keyData.key<<" pressed: "<<keyData.pressed;
+
+  KeyFrame key;
+  if (!cecUserControlCode(keyData.key, key.keyCode))
+    return HANDLER_ERROR_INVALID_PARAMTERS;
+
+  if (!keyData.adapter.empty()) {
+    if (ValidateAdapter(keyData.adapter) != HANDLER_ERROR_OK)
+      return HANDLER_ERROR_INVALID_ADAPTER;
+  }
+
+  // Resolved once here, the key lane only ever sees a logical address.
+  int logicalAddress = ResolveLogicalAddress(keyData.adapter, keyData.destAddress);
+  if (logicalAddress < 0 || logicalAddress >= CEC_BROADCAST_ADDRESS)
+    return HANDLER_ERROR_INVALID_DESTINATION;
+
+  key.adapter = keyData.adapter;
+  key.destination = static_cast<uint8_t>(logicalAddress);
+  key.pressed = keyData.pressed;
+
+  if (keyData.hold) {
+    if (keyData.repeatInterval < MIN_KEY_REPEAT_INTERVAL_MS || keyData.repeatInterval > MAX_KEY_REPEAT_INTERVAL_MS)
+      return HANDLER_ERROR_INVALID_PARAMTERS;
+    if (keyData.holdTimeout <= 0 || keyData.holdTimeout > MAX_KEY_HOLD_TIMEOUT_MS)
+      return HANDLER_ERROR_INVALID_PARAMTERS;
+    if (!mQueue.holdKey(key, std::chrono::milliseconds(keyData.repeatInterval), std::chrono::milliseconds(keyData.holdTimeout)))
+      return HANDLER_ERROR_UNKNOWN;
+    return HANDLER_ERROR_OK;
+  }
+
+  if (!mQueue.sendKey(key))
+    return HANDLER_ERROR_UNKNOWN;
+  return HANDLER_ERROR_OK;
+}
+
+// Called with mMutex held, after any change to the device table. The
+// tables are small, rebuilding is cheaper than keeping the trees in step.
+void DefaultCecHandler::RebuildTopology() {
+  for (auto &topology : mTopologies)
+    topology.second.rebuild(mDeviceInfoList, topology.first);
+  for (auto &device : mDeviceInfoList) {
+    if (mTopologies.find(device.getAdapter()) == mTopologies.end())
+      mTopologies[device.getAdapter()].rebuild(mDeviceInfoList, device.getAdapter());
+  }
+}
+
+HandlerErrorCode DefaultCecHandler::GetTopology(const std::string &adapter, CecTopology &topology) {
+  if (ValidateAdapter(adapter) != HANDLER_ERROR_OK)
+    return HANDLER_ERROR_INVALID_ADAPTER;
+
+  std::unique_lock<std::mutex> lock(mMutex);
+  auto it = mTopologies.find(adapter);
+  if (it == mTopologies.end())
+    topology = CecTopology();
+  else
+    topology = it->second;
+  return HANDLER_ERROR_OK;
+}
+
+HandlerErrorCode DefaultCecHandler::GetBusStatus(std::vector<BusStatus> &status) {
+  status = mQueue.getBusStatus();
+  return HANDLER_ERROR_OK;
+}
+
 HandlerErrorCode DefaultCecHandler::ValidateSendCommand(std::shared_ptr<Command> command) {
   std::shared_ptr<SendCommandReqData> commandData = std::static_pointer_cast<SendCommandReqData>(command->getData());
 
@@ -849,9 +1937,13 @@ HandlerErrorCode DefaultCecHandler::ValidateSendCommand(std::shared_ptr<Command>
       return HANDLER_ERROR_INVALID_ADAPTER;
   }
 
-  if (ValidateAddress(commandData->destAddress) != HANDLER_ERROR_OK)
+  bool known = ValidateAddress(commandData->adapter, commandData->destAddress) == HANDLER_ERROR_OK;
+  if (!known && !commandData->discover)
     return HANDLER_ERROR_INVALID_DESTINATION;
 
+  if (known && !mRetry.AllowSend(commandData->adapter, ResolveLogicalAddress(commandData->adapter, commandData->destAddress)))
+    return HANDLER_ERROR_DESTINATION_UNAVAILABLE;
+
   if (commandData->command.name == "report-power-status") {
 
    if (commandData->command.args.size() != 1)
@@ -943,6 +2035,10 @@ HandlerErrorCode DefaultCecHandler::ValidateSendCommand(std::shared_ptr<Command>
 
   }
 
+  // Arguments are checked before any bus time goes into discovery
+  if (!known)
+    return HANDLER_ERROR_DESTINATION_UNKNOWN;
+
   return HANDLER_ERROR_OK;
 }
 
@@ -953,7 +2049,7 @@ HandlerErrorCode DefaultCecHandler::ValidateListAdapters(std::shared_ptr<Command
 HandlerErrorCode DefaultCecHandler::ValidateScan(std::shared_ptr<Command> command) {
   std::shared_ptr<ScanReqData> scanData = std::static_pointer_cast<ScanReqData>(command->getData());
 
-  if (!scanData->adapter.empty()) {
+  if (!scanData->adapter.empty() && scanData->adapter != SCAN_ALL_ADAPTERS) {
     if (ValidateAdapter(scanData->adapter) != HANDLER_ERROR_OK)
       return HANDLER_ERROR_INVALID_ADAPTER;
   }
@@ -1008,3 +2104,28 @@ HandlerErrorCode DefaultCecHandler::ValidateSetConfig(std::shared_ptr<Command> c
   return HANDLER_ERROR_OK;
 }
 
+HandlerErrorCode DefaultCecHandler::ValidateSendFrame(std::shared_ptr<Command> command) {
+  std::shared_ptr<SendFrameReqData> frameData = std::static_pointer_cast<SendFrameReqData>(command->getData());
+
+  if (!frameData->adapter.empty()) {
+    if (ValidateAdapter(frameData->adapter) != HANDLER_ERROR_OK)
+      return HANDLER_ERROR_INVALID_ADAPTER;
+  }
+
+  if (frameData->frame.destination > CEC_BROADCAST_ADDRESS)
+    return HANDLER_ERROR_INVALID_DESTINATION;
+
+  if (frameData->timeout <= 0 || !validateCecFrame(frameData->frame))
+    return HANDLER_ERROR_INVALID_PARAMTERS;
+
+#ifndef NYX_RAW_POLLS
+  // See MessageQueue::sendFrame
+  if (!frameData->frame.hasOpcode)
+    return HANDLER_ERROR_INVALID_PARAMTERS;
+#endif
+
+  if (!mRetry.AllowSend(frameData->adapter, frameData->frame.destination))
+    return HANDLER_ERROR_DESTINATION_UNAVAILABLE;
+
+  return HANDLER_ERROR_OK;
+}
@@ -26,7 +26,7 @@ LGTVCecHandler::~LGTVCecHandler() {
 }
 
 bool LGTVCecHandler::HandleCommand(std::shared_ptr<Command> command) {
-  AppLogInfo()<<" LGTVCecHandler::"<<__func__<<":"<<__LINE__;
+  AppLogDebug()<<" LGTVCecHandler::"<<__func__<<":"<<__LINE__;
 
   if (command->getType() != SEND_COMMAND) {
     return false;
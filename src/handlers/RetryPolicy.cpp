@@ -0,0 +1,105 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include <algorithm>
+
+#include "Logger.h"
+#include "RetryPolicy.h"
+
+RetryPolicy::RetryPolicy() :
+    mRandom(static_cast<unsigned>(std::chrono::steady_clock::now().time_since_epoch().count())) {
+}
+
+int RetryPolicy::GetBudget(CommandType type) {
+  switch(type) {
+    case SEND_COMMAND:
+    case SEND_FRAME:
+    case LIST_ADAPTERS:
+      return 2;
+
+    case SCAN:
+      return 1;
+
+    default:
+      // Config failures are not transient and keys are fire and forget
+      return 0;
+  }
+}
+
+std::chrono::milliseconds RetryPolicy::GetBackoff(int attempt) {
+  int delay = RETRY_BASE_DELAY_MS << std::min(std::max(attempt - 1, 0), 5);
+  delay = std::min(delay, RETRY_MAX_DELAY_MS);
+
+  // Random in [delay/2, delay] so that clients failing together do not
+  // retry together.
+  std::unique_lock<std::mutex> lock(mMutex);
+  std::uniform_int_distribution<int> jitter(delay / 2, delay);
+  return std::chrono::milliseconds(jitter(mRandom));
+}
+
+RetryPolicy::Breaker& RetryPolicy::GetBreaker(const std::string &adapter, int address) {
+  return mBreakers[std::make_pair(adapter.empty() ? DEFAULT_CEC_ADAPTER : adapter, address)];
+}
+
+bool RetryPolicy::AllowSend(const std::string &adapter, int address) {
+  if (!IsTracked(address))
+    return true;
+
+  std::unique_lock<std::mutex> lock(mMutex);
+  Breaker &breaker = GetBreaker(adapter, address);
+  if (breaker.state == BREAKER_CLOSED)
+    return true;
+
+  auto now = std::chrono::steady_clock::now();
+  if (now < breaker.openUntil)
+    return false;
+
+  // Cooldown over, or the previous probe never got an answer
+  breaker.state = BREAKER_HALF_OPEN;
+  breaker.openUntil = now + breaker.cooldown;
+  return true;
+}
+
+void RetryPolicy::RecordSuccess(const std::string &adapter, int address) {
+  if (!IsTracked(address))
+    return;
+
+  std::unique_lock<std::mutex> lock(mMutex);
+  Breaker &breaker = GetBreaker(adapter, address);
+  if (breaker.state != BREAKER_CLOSED)
+    AppLogInfo()<<" RetryPolicy::"<<__func__<<":"<<__LINE__<<" closing circuit for "<<adapter<<" "<<address;
+  breaker = Breaker();
+}
+
+void RetryPolicy::RecordFailure(const std::string &adapter, int address) {
+  if (!IsTracked(address))
+    return;
+
+  std::unique_lock<std::mutex> lock(mMutex);
+  Breaker &breaker = GetBreaker(adapter, address);
+  breaker.failures++;
+
+  if (breaker.state == BREAKER_HALF_OPEN) {
+    breaker.cooldown = std::min(breaker.cooldown * 2, std::chrono::milliseconds(BREAKER_MAX_COOLDOWN_MS));
+  } else if (breaker.state == BREAKER_OPEN || breaker.failures < BREAKER_FAILURE_THRESHOLD) {
+    return;
+  }
+
+  AppLogInfo()<<" RetryPolicy::"<<__func__<<":"<<__LINE__<<" opening circuit for "<<adapter<<" "<<address
+              <<" for "<<breaker.cooldown.count()<<"ms";
+  breaker.state = BREAKER_OPEN;
+  breaker.openUntil = std::chrono::steady_clock::now() + breaker.cooldown;
+}
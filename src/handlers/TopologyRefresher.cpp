@@ -0,0 +1,111 @@
+// Copyright (c) 2024 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+#include <algorithm>
+
+#include "Logger.h"
+#include "TopologyRefresher.h"
+
+TopologyRefresher::TopologyRefresher(RefreshFunction refresh) :
+    mRefresh(std::move(refresh)), mInterval(TOPOLOGY_REFRESH_MIN_MS) {
+}
+
+TopologyRefresher::~TopologyRefresher() {
+  std::unique_lock<std::mutex> lock(mMutex);
+  if (mTimer)
+    g_source_remove(mTimer);
+}
+
+void TopologyRefresher::Start() {
+  std::unique_lock<std::mutex> lock(mMutex);
+  if (mStarted)
+    return;
+  mStarted = true;
+  Schedule(std::chrono::milliseconds(0));
+}
+
+void TopologyRefresher::RefreshDone(bool changed) {
+  std::unique_lock<std::mutex> lock(mMutex);
+  mRefreshing = false;
+  mFullDone = true;
+  if (changed || mHotPlugPending)
+    mInterval = std::chrono::milliseconds(TOPOLOGY_REFRESH_MIN_MS);
+  else
+    mInterval = std::min(mInterval * 2, std::chrono::milliseconds(TOPOLOGY_REFRESH_MAX_MS));
+
+  std::chrono::milliseconds delay = mInterval;
+  if (mHotPlugPending)
+    delay = std::chrono::milliseconds(TOPOLOGY_HOTPLUG_DELAY_MS);
+  mHotPlugPending = false;
+  AppLogDebug()<<" TopologyRefresher::"<<__func__<<":"<<__LINE__<<" changed: "<<changed
+               <<" next in "<<delay.count()<<"ms";
+  Schedule(delay);
+}
+
+void TopologyRefresher::NotifyHotPlug() {
+  std::unique_lock<std::mutex> lock(mMutex);
+  mInterval = std::chrono::milliseconds(TOPOLOGY_REFRESH_MIN_MS);
+  if (mRefreshing) {
+    mHotPlugPending = true;
+    return;
+  }
+  if (mStarted && mFullDone)
+    Schedule(std::chrono::milliseconds(TOPOLOGY_HOTPLUG_DELAY_MS));
+}
+
+void TopologyRefresher::SetStandby(bool standby) {
+  std::unique_lock<std::mutex> lock(mMutex);
+  if (mStandby == standby)
+    return;
+  mStandby = standby;
+  AppLogInfo()<<" TopologyRefresher::"<<__func__<<":"<<__LINE__<<(standby ? " pausing" : " resuming");
+  if (standby) {
+    if (mTimer)
+      g_source_remove(mTimer);
+    mTimer = 0;
+    return;
+  }
+  // Devices may have come and gone while nobody looked
+  mInterval = std::chrono::milliseconds(TOPOLOGY_REFRESH_MIN_MS);
+  if (!mRefreshing)
+    Schedule(std::chrono::milliseconds(TOPOLOGY_HOTPLUG_DELAY_MS));
+}
+
+void TopologyRefresher::Schedule(std::chrono::milliseconds delay) {
+  if (!mStarted || mStandby)
+    return;
+  if (mTimer)
+    g_source_remove(mTimer);
+  mTimer = g_timeout_add(static_cast<guint>(delay.count()), &TopologyRefresher::TimeoutCb, this);
+}
+
+gboolean TopologyRefresher::TimeoutCb(gpointer data) {
+  TopologyRefresher *self = static_cast<TopologyRefresher*>(data);
+  bool full;
+  {
+    std::unique_lock<std::mutex> lock(self->mMutex);
+    // Schedule() may already have replaced this timer from another thread
+    if (self->mTimer == g_source_get_id(g_main_current_source()))
+      self->mTimer = 0;
+    if (self->mRefreshing || self->mStandby)
+      return G_SOURCE_REMOVE;
+    self->mRefreshing = true;
+    full = !self->mFullDone;
+  }
+  self->mRefresh(full);
+  return G_SOURCE_REMOVE;
+}